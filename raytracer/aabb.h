@@ -0,0 +1,125 @@
+//
+//  Framework for a raytracer
+//  File: aabb.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef AABB_H_FABIOUX_LEOBAL
+#define AABB_H_FABIOUX_LEOBAL
+
+#include <limits>
+#include "triple.h"
+
+// Axis-aligned bounding box. A default-constructed box is empty (min > max)
+// and grows with extend().
+class AABB
+{
+public:
+    Point min, max;
+
+    AABB()
+        : min(std::numeric_limits<double>::infinity(),
+              std::numeric_limits<double>::infinity(),
+              std::numeric_limits<double>::infinity()),
+          max(-std::numeric_limits<double>::infinity(),
+              -std::numeric_limits<double>::infinity(),
+              -std::numeric_limits<double>::infinity())
+    { }
+
+    AABB(const Point& min, const Point& max) : min(min), max(max) { }
+
+    // Box covering the whole space, for unbounded objects (planes)
+    static AABB infinite()
+    {
+        double inf = std::numeric_limits<double>::infinity();
+        return AABB(Point(-inf, -inf, -inf), Point(inf, inf, inf));
+    }
+
+    void extend(const Point& p)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (p.data[i] < min.data[i]) min.data[i] = p.data[i];
+            if (p.data[i] > max.data[i]) max.data[i] = p.data[i];
+        }
+    }
+
+    void extend(const AABB& b)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (b.min.data[i] < min.data[i]) min.data[i] = b.min.data[i];
+            if (b.max.data[i] > max.data[i]) max.data[i] = b.max.data[i];
+        }
+    }
+
+    bool isEmpty() const
+    { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+    bool isFinite() const
+    {
+        for (int i = 0; i < 3; i++)
+            if (!(fabs(min.data[i]) < std::numeric_limits<double>::infinity())
+                || !(fabs(max.data[i]) < std::numeric_limits<double>::infinity()))
+                return false;
+        return true;
+    }
+
+    Point centroid() const { return (min + max) * 0.5; }
+
+    // Surface area, used as the probability measure of the SAH
+    double area() const
+    {
+        if (isEmpty())
+            return 0.0;
+        Vector d = max - min;
+        return 2.0 * (d.x*d.y + d.y*d.z + d.z*d.x);
+    }
+
+    // Index of the longest axis (0 = x, 1 = y, 2 = z)
+    int longestAxis() const
+    {
+        Vector d = max - min;
+        if (d.x > d.y && d.x > d.z)
+            return 0;
+        return d.y > d.z ? 1 : 2;
+    }
+
+    // Slab test. invD is the componentwise inverse of the ray direction.
+    // Returns true if the box overlaps the ray between 0 and tMax, and stores
+    // the entry distance in tNear.
+    bool intersect(const Point& O, const Vector& invD, double tMax, double& tNear) const
+    {
+        double t0 = 0.0, t1 = tMax;
+        for (int i = 0; i < 3; i++)
+        {
+            double tA = (min.data[i] - O.data[i]) * invD.data[i];
+            double tB = (max.data[i] - O.data[i]) * invD.data[i];
+            if (tA > tB) { double tmp = tA; tA = tB; tB = tmp; }
+            // written so that NaN (0 * inf on a slab border) keeps the bounds
+            t0 = tA > t0 ? tA : t0;
+            t1 = tB < t1 ? tB : t1;
+            if (t0 > t1)
+                return false;
+        }
+        tNear = t0;
+        return true;
+    }
+};
+
+#endif /* end of include guard: AABB_H_FABIOUX_LEOBAL */
@@ -0,0 +1,476 @@
+//
+//  Framework for a raytracer
+//  File: bench.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+//  Benchmarks: intersection kernels on fixed sets of rays, then whole scenes.
+//  Build with "make bench", and run "./bench -h" for the options.
+//
+
+#include <chrono>
+#include <fstream>
+#include <glob.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "cylinder.h"
+#include "plane.h"
+#include "raytracer.h"
+#include "scheduler.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "trianglepack.h"
+
+// Result of one kernel: time per ray-object test
+struct KernelResult
+{
+    std::string name;
+    long tests;
+    double seconds;
+    double checksum;
+};
+
+// Result of one scene: time to load it and to render it
+struct SceneResult
+{
+    std::string file;
+    int width, height, threads;
+    double loadSeconds, renderSeconds;
+    long long primaryRays;
+    long long rays; // of all kinds, in one render
+};
+
+// Result of loading a generated scene: time to parse it and build its BVH
+struct LoadResult
+{
+    int objects;
+    double seconds;
+};
+
+// Fixed pseudo-random numbers, so that every run tests the same rays
+static double random01()
+{
+    return rand() / (double)RAND_MAX;
+}
+
+static Point randomPoint(double size)
+{
+    return Point(random01() * size, random01() * size, random01() * size);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rays from outside a unit cube, aimed at random points inside it
+static std::vector<Ray> makeRays(int count)
+{
+    std::vector<Ray> rays;
+    for (int i = 0; i < count; i++)
+    {
+        Point from = Point(0.5, 0.5, 0.5) + (randomPoint(2.0) - 1.0).normalized() * 3.0;
+        Point to = randomPoint(1.0);
+        rays.push_back(Ray(from, (to - from).normalized()));
+    }
+    return rays;
+}
+
+static void printKernel(const KernelResult& result)
+{
+    std::cout << std::left << std::setw(28) << result.name << std::right
+        << std::fixed << std::setprecision(2) << std::setw(8) << result.seconds * 1e9 / result.tests << " ns/test"
+        << "   (checksum " << std::setprecision(3) << result.checksum << ")" << std::endl;
+}
+
+// Every ray against every object, looking for the nearest hit, as the
+// scene does without acceleration structure. The checksum (sum of the
+// nearest distances) keeps the compiler from optimizing the loops away.
+static KernelResult benchObjects(const char* name, const std::vector<Object*>& objects,
+    const std::vector<Ray>& rays, int repeat)
+{
+    KernelResult result;
+    result.name = name;
+    result.tests = (long)objects.size() * rays.size() * repeat;
+    result.checksum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int k = 0; k < repeat; k++)
+        for (unsigned int r = 0; r < rays.size(); r++)
+        {
+            double nearest = std::numeric_limits<double>::infinity();
+            for (unsigned int i = 0; i < objects.size(); i++)
+            {
+                Hit hit(objects[i]->intersect(rays[r]));
+                if (hit.t < nearest)
+                    nearest = hit.t;
+            }
+            if (nearest < std::numeric_limits<double>::infinity())
+                result.checksum += nearest;
+        }
+    result.seconds = seconds(start);
+    printKernel(result);
+    return result;
+}
+
+// Small random objects of every kind in the unit cube
+static std::vector<KernelResult> benchPrimitives(int numObjects, int numRays, int repeat)
+{
+    std::vector<KernelResult> results;
+    std::vector<Ray> rays = makeRays(numRays);
+    std::vector<Object*> spheres, triangles, cylinders, planes;
+    for (int i = 0; i < numObjects; i++)
+    {
+        Point p0 = randomPoint(1.0);
+        spheres.push_back(new Sphere(p0, 0.01 + random01() * 0.05));
+        triangles.push_back(new Triangle(p0, p0 + (randomPoint(0.2) - 0.1), p0 + (randomPoint(0.2) - 0.1)));
+        cylinders.push_back(new Cylinder(p0, p0 + (randomPoint(0.2) - 0.1), 0.01 + random01() * 0.03));
+        planes.push_back(new Plane(p0, (randomPoint(2.0) - 1.0).normalized()));
+    }
+
+    std::cout << "Primitives: " << numObjects << " objects of each kind, " << numRays << " rays" << std::endl;
+    results.push_back(benchObjects("Sphere::intersect", spheres, rays, repeat));
+    results.push_back(benchObjects("Triangle::intersect", triangles, rays, repeat));
+    results.push_back(benchObjects("Cylinder::intersect", cylinders, rays, repeat));
+    results.push_back(benchObjects("Plane::intersect", planes, rays, repeat));
+
+    for (int i = 0; i < numObjects; i++)
+    {
+        delete spheres[i];
+        delete triangles[i];
+        delete cylinders[i];
+        delete planes[i];
+    }
+    return results;
+}
+
+// One ray against many triangles: the packed kernels (plain C++ and SIMD),
+// to compare with Triangle::intersect.
+static std::vector<KernelResult> benchTrianglePacks(int numTriangles, int numRays, int repeat)
+{
+    std::vector<KernelResult> results;
+    std::vector<TrianglePack> packs;
+    for (int i = 0; i < numTriangles; i++)
+    {
+        Point p0 = randomPoint(1.0);
+        Point p1 = p0 + (randomPoint(0.2) - 0.1);
+        Point p2 = p0 + (randomPoint(0.2) - 0.1);
+        if (i % TRIANGLE_PACK_WIDTH == 0)
+            packs.push_back(TrianglePack());
+        packs.back().set(i % TRIANGLE_PACK_WIDTH, p0, p1, p2, i);
+    }
+    std::vector<Ray> rays = makeRays(numRays);
+
+    std::cout << "Triangle packs: " << numTriangles << " triangles, " << numRays << " rays, "
+        << "packs of " << TRIANGLE_PACK_WIDTH << std::endl;
+
+    for (int simd = 0; simd < 2; simd++)
+    {
+        KernelResult result;
+        result.name = simd ? "intersectPack (SIMD)" : "intersectPackScalar";
+        result.tests = (long)numTriangles * numRays * repeat;
+        result.checksum = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int k = 0; k < repeat; k++)
+            for (unsigned int r = 0; r < rays.size(); r++)
+            {
+                PackRay packRay(rays[r]);
+                float nearest = std::numeric_limits<float>::infinity(), t;
+                for (unsigned int p = 0; p < packs.size(); p++)
+                    if ((simd ? intersectPack(packs[p], packRay, -1, nearest, t)
+                        : intersectPackScalar(packs[p], packRay, -1, nearest, t)) >= 0)
+                        nearest = t;
+                if (nearest < std::numeric_limits<float>::infinity())
+                    result.checksum += nearest;
+            }
+        result.seconds = seconds(start);
+        printKernel(result);
+        results.push_back(result);
+    }
+    return results;
+}
+
+// Loads and renders a scene file (the image is not written). The scene is
+// rendered repeat times, and the fastest render is kept.
+static bool benchScene(const std::string& file, double scale, int threads, int repeat, SceneResult& result)
+{
+    // The raytracer tells a lot about what it does: not here
+    std::ostringstream quiet;
+    std::streambuf* out = std::cout.rdbuf(quiet.rdbuf());
+
+    Raytracer raytracer;
+    if (threads >= 0)
+        raytracer.setNumThreads(threads);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool ok = raytracer.readScene(file);
+    result.loadSeconds = seconds(start);
+
+    if (ok)
+    {
+        Scene* scene = raytracer.getScene();
+        RenderStats stats;
+        scene->setStats(&stats);
+        scene->setPrintProgression(0);
+        scene->setWidth(std::max(1, (int)(scene->getWidth() * scale)));
+        scene->setHeight(std::max(1, (int)(scene->getHeight() * scale)));
+
+        result.file = file;
+        result.width = scene->getWidth();
+        result.height = scene->getHeight();
+        result.threads = scene->getNumThreads() > 0 ? scene->getNumThreads() : TileScheduler::defaultThreads();
+        result.renderSeconds = std::numeric_limits<double>::infinity();
+        for (int k = 0; k < repeat; k++)
+        {
+            Image img(result.width, result.height);
+            start = std::chrono::steady_clock::now();
+            scene->render(img);
+            result.renderSeconds = std::min(result.renderSeconds, seconds(start));
+        }
+        result.primaryRays = scene->getNumPrimaryRays();
+
+        // Every render traces the same rays
+        result.rays = 0;
+        for (int i = 0; i < RenderCounters::numRayTypes; i++)
+            result.rays += stats.counters.rays[i];
+        result.rays /= repeat;
+        scene->setStats(NULL);
+    }
+
+    std::cout.rdbuf(out);
+    if (!ok)
+    {
+        std::cerr << "Error: reading scene from " << file << " failed." << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(40) << file << std::right << " "
+        << result.width << "x" << result.height << std::fixed << std::setprecision(3)
+        << "   load " << result.loadSeconds << "s   render " << result.renderSeconds << "s   "
+        << std::setprecision(2) << result.rays / result.renderSeconds / 1e6 << " Mrays/s" << std::endl;
+    return true;
+}
+
+// Writes a scene of numObjects spheres and triangles, half of them giving
+// the optional keys (up, spin, opacity, eta) and half relying on defaults,
+// then times how long reading it takes.
+static bool benchLoad(int numObjects, LoadResult& result)
+{
+    char file[] = "/tmp/benchloadXXXXXX";
+    int fd = mkstemp(file);
+    if (fd < 0)
+    {
+        std::cerr << "Error: can't create a temporary scene file." << std::endl;
+        return false;
+    }
+    close(fd);
+
+    {
+        std::ofstream yaml(file);
+        yaml << "---" << std::endl
+            << "Camera: {position: [0, 0, 2000], lookat: [0, 0, 0], up: [0, 1, 0], resolution: [64, 64]}" << std::endl
+            << "Lights:" << std::endl
+            << "- {position: [0, 0, 1500], color: [1, 1, 1]}" << std::endl
+            << "Objects:" << std::endl;
+        for (int i = 0; i < numObjects; i++)
+        {
+            Point p = randomPoint(1000.0);
+            yaml << "- type: " << (i % 4 < 2 ? "sphere" : "triangle") << std::endl;
+            if (i % 4 < 2)
+                yaml << "  position: [" << p.x << ", " << p.y << ", " << p.z << "]" << std::endl
+                    << "  radius: " << 1.0 + random01() << std::endl;
+            else
+                yaml << "  point1: [" << p.x << ", " << p.y << ", " << p.z << "]" << std::endl
+                    << "  point2: [" << p.x + 1.0 << ", " << p.y << ", " << p.z << "]" << std::endl
+                    << "  point3: [" << p.x << ", " << p.y + 1.0 << ", " << p.z << "]" << std::endl;
+            if (i % 2 == 0 && i % 4 < 2)
+                yaml << "  up: [0, 1, 0]" << std::endl << "  spin: 0.25" << std::endl;
+            yaml << "  material: {color: [0.5, 0.5, 1], ka: 0.2, kd: 0.7, ks: 0.5, n: 64";
+            if (i % 2 == 0)
+                yaml << ", opacity: 1, eta: 1";
+            yaml << "}" << std::endl;
+        }
+    }
+
+    std::ostringstream quiet;
+    std::streambuf* out = std::cout.rdbuf(quiet.rdbuf());
+    Raytracer raytracer;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool ok = raytracer.readScene(file);
+    result.seconds = seconds(start);
+    result.objects = numObjects;
+    std::cout.rdbuf(out);
+    unlink(file);
+
+    if (!ok)
+    {
+        std::cerr << "Error: reading the generated scene failed." << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(28) << "generated scene" << std::right
+        << numObjects << " objects   " << std::fixed << std::setprecision(3) << result.seconds << "s   "
+        << std::setprecision(0) << numObjects / result.seconds << " objects/s" << std::endl;
+    return true;
+}
+
+// s as a JSON string, quotes included
+static std::string jsonString(const std::string& s)
+{
+    std::ostringstream out;
+    out << '"';
+    for (unsigned int i = 0; i < s.size(); i++)
+    {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+// Everything found, in a JSON file, to keep track of performance over time
+static void writeJson(const char* filename, const std::vector<KernelResult>& kernels,
+    const std::vector<LoadResult>& loads, const std::vector<SceneResult>& scenes)
+{
+    std::ofstream json(filename);
+    json << std::setprecision(6) << "{" << std::endl;
+    json << "  \"kernels\": [";
+    for (unsigned int i = 0; i < kernels.size(); i++)
+    {
+        const KernelResult& k = kernels[i];
+        json << (i ? "," : "") << std::endl << "    { \"name\": " << jsonString(k.name)
+            << ", \"tests\": " << k.tests
+            << ", \"seconds\": " << k.seconds
+            << ", \"nsPerIntersection\": " << k.seconds * 1e9 / k.tests
+            << ", \"intersectionsPerSecond\": " << k.tests / k.seconds
+            << ", \"checksum\": " << k.checksum << " }";
+    }
+    json << std::endl << "  ]," << std::endl;
+    json << "  \"load\": [";
+    for (unsigned int i = 0; i < loads.size(); i++)
+    {
+        const LoadResult& l = loads[i];
+        json << (i ? "," : "") << std::endl << "    { \"objects\": " << l.objects
+            << ", \"seconds\": " << l.seconds
+            << ", \"objectsPerSecond\": " << l.objects / l.seconds << " }";
+    }
+    json << std::endl << "  ]," << std::endl;
+    json << "  \"scenes\": [";
+    for (unsigned int i = 0; i < scenes.size(); i++)
+    {
+        const SceneResult& s = scenes[i];
+        json << (i ? "," : "") << std::endl << "    { \"file\": " << jsonString(s.file)
+            << ", \"width\": " << s.width
+            << ", \"height\": " << s.height
+            << ", \"threads\": " << s.threads
+            << ", \"loadSeconds\": " << s.loadSeconds
+            << ", \"renderSeconds\": " << s.renderSeconds
+            << ", \"primaryRays\": " << s.primaryRays
+            << ", \"rays\": " << s.rays
+            << ", \"raysPerSecond\": " << s.rays / s.renderSeconds << " }";
+    }
+    json << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    const char* jsonFile = 0;
+    bool kernels = true, load = true, scenes = true;
+    double scale = 1.0;
+    int threads = -1, repeat = 1, numObjects = 20000;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0 && i+1 < argc)
+            jsonFile = argv[++i];
+        else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--scale") == 0 && i+1 < argc)
+            scale = atof(argv[++i]);
+        else if (strcmp(argv[i], "--repeat") == 0 && i+1 < argc)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--objects") == 0 && i+1 < argc)
+            numObjects = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--kernels") == 0)
+            load = scenes = false;
+        else if (strcmp(argv[i], "--load") == 0)
+            kernels = scenes = false;
+        else if (strcmp(argv[i], "--scenes") == 0)
+            kernels = load = false;
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Usage: " << argv[0] << " [--kernels | --load | --scenes] [--json file] [-t threads]" << std::endl
+                << "       [--objects n] [--scale factor] [--repeat n] [scene.yaml ...]" << std::endl
+                << "--objects sets the size of the generated scene whose loading is timed." << std::endl
+                << "Scenes default to ../raytracer-binary/*.yaml. --scale multiplies their" << std::endl
+                << "resolution, --repeat renders each n times and keeps the fastest." << std::endl;
+            return 1;
+        }
+        else
+            files.push_back(argv[i]);
+    }
+
+    std::vector<KernelResult> kernelResults;
+    if (kernels)
+    {
+        srand(1);
+        std::vector<KernelResult> results = benchPrimitives(1024, 256, 4);
+        kernelResults.insert(kernelResults.end(), results.begin(), results.end());
+        results = benchTrianglePacks(4096, 256, 4);
+        kernelResults.insert(kernelResults.end(), results.begin(), results.end());
+    }
+
+    std::vector<LoadResult> loadResults;
+    if (load)
+    {
+        std::cout << "Loading:" << std::endl;
+        LoadResult result;
+        srand(1);
+        if (benchLoad(numObjects, result))
+            loadResults.push_back(result);
+    }
+
+    std::vector<SceneResult> sceneResults;
+    if (scenes)
+    {
+        if (files.empty())
+        {
+            glob_t found;
+            if (glob("../raytracer-binary/*.yaml", 0, 0, &found) == 0)
+                for (size_t i = 0; i < found.gl_pathc; i++)
+                    files.push_back(found.gl_pathv[i]);
+            globfree(&found);
+        }
+        std::cout << "Scenes:" << std::endl;
+        for (unsigned int i = 0; i < files.size(); i++)
+        {
+            SceneResult result;
+            if (benchScene(files[i], scale, threads, repeat, result))
+                sceneResults.push_back(result);
+        }
+    }
+
+    if (jsonFile)
+        writeJson(jsonFile, kernelResults, loadResults, sceneResults);
+    return 0;
+}
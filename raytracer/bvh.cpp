@@ -0,0 +1,492 @@
+//
+//  Framework for a raytracer
+//  File: bvh.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "bvh.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <thread>
+
+// Number of buckets the centroids are sorted into when evaluating the SAH
+#define BVH_BINS 16
+
+// Cost of visiting a node, relative to intersecting one primitive
+#define BVH_TRAVERSAL_COST 1.0
+
+// Leaves are never made larger than this unless the primitives can't be
+// told apart (identical centroids)
+#define BVH_MAX_LEAF_SIZE 8
+
+// Largest leaves of the linear builder, which splits them no matter the cost
+#define LBVH_LEAF_SIZE 4
+
+// Subtrees with fewer primitives are not worth a thread of their own
+#define BVH_PARALLEL_SIZE 4096
+
+void BVH::build(const std::vector<AABB>& boxes, Builder builder, int numThreads)
+{
+    nodes.clear();
+    indices.resize(boxes.size());
+    if (boxes.empty())
+        return;
+
+    // One thread per subtree at that depth: enough for every core to work
+    parallelDepth = 0;
+    while ((1 << parallelDepth) < numThreads)
+        parallelDepth++;
+
+    nodes.reserve(2 * boxes.size());
+    if (builder == lbvh)
+    {
+        buildLinear(boxes, numThreads);
+        return;
+    }
+
+    std::vector<Point> centroids(boxes.size());
+    for (unsigned int i = 0; i < boxes.size(); i++)
+    {
+        indices[i] = i;
+        centroids[i] = boxes[i].centroid();
+    }
+    buildNode(boxes, centroids, 0, boxes.size(), 0, nodes);
+}
+
+double BVH::sahCost() const
+{
+    if (nodes.empty() || !(nodes[0].box.area() > 0))
+        return 0.0;
+
+    double cost = 0.0;
+    for (unsigned int n = 0; n < nodes.size(); n++)
+        cost += nodes[n].box.area() * (nodes[n].count > 0 ? nodes[n].count : BVH_TRAVERSAL_COST);
+    return cost / nodes[0].box.area();
+}
+
+template <class Build>
+void BVH::buildChildren(std::vector<Node>& out, unsigned int index,
+    unsigned int begin, unsigned int mid, unsigned int end, int depth, Build& build)
+{
+    if (depth >= parallelDepth || end - begin < BVH_PARALLEL_SIZE)
+    {
+        build(begin, mid, depth + 1, out);
+        out[index].start = build(mid, end, depth + 1, out);
+        return;
+    }
+
+    // The children work on separate ranges of indices, so they can be built
+    // at the same time: the right one into its own array, which is then
+    // appended to ours (its inner nodes pointing further).
+    std::vector<Node> rightNodes;
+    std::thread right([&]() { build(mid, end, depth + 1, rightNodes); });
+    build(begin, mid, depth + 1, out);
+    right.join();
+
+    unsigned int offset = out.size();
+    for (unsigned int n = 0; n < rightNodes.size(); n++)
+        if (rightNodes[n].count == 0)
+            rightNodes[n].start += offset;
+    out[index].start = offset;
+    out.insert(out.end(), rightNodes.begin(), rightNodes.end());
+}
+
+unsigned int BVH::buildNode(const std::vector<AABB>& boxes,
+    const std::vector<Point>& centroids,
+    unsigned int begin, unsigned int end, int depth, std::vector<Node>& out)
+{
+    // Careful: out may be reallocated by the recursive calls, so we only
+    // keep indices into it, never references.
+    unsigned int index = out.size();
+    out.push_back(Node());
+
+    AABB box, centroidBox;
+    for (unsigned int i = begin; i < end; i++)
+    {
+        box.extend(boxes[indices[i]]);
+        centroidBox.extend(centroids[indices[i]]);
+    }
+    out[index].box = box;
+    out[index].start = begin;
+    out[index].count = end - begin;
+
+    unsigned int count = end - begin;
+    if (count <= 1 || depth >= MAX_DEPTH)
+        return index;
+
+    // Binned SAH: sort the centroids into buckets along each axis, and
+    // evaluate the cost of splitting between every two consecutive buckets:
+    //     cost = traversal + (area(L) * count(L) + area(R) * count(R)) / area
+    double bestCost = std::numeric_limits<double>::infinity();
+    int bestAxis = -1, bestSplit = 0;
+    double area = box.area();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double cMin = centroidBox.min.data[axis];
+        double extent = centroidBox.max.data[axis] - cMin;
+        if (!(extent > 0))
+            continue;
+
+        AABB binBoxes[BVH_BINS];
+        unsigned int binCounts[BVH_BINS] = { 0 };
+        for (unsigned int i = begin; i < end; i++)
+        {
+            int b = (int)(BVH_BINS * (centroids[indices[i]].data[axis] - cMin) / extent);
+            if (b >= BVH_BINS) b = BVH_BINS - 1;
+            binBoxes[b].extend(boxes[indices[i]]);
+            binCounts[b]++;
+        }
+
+        // Sweep from the right to get the area and count of every right side
+        double rightArea[BVH_BINS];
+        unsigned int rightCount[BVH_BINS];
+        AABB acc;
+        unsigned int n = 0;
+        for (int b = BVH_BINS - 1; b > 0; b--)
+        {
+            acc.extend(binBoxes[b]);
+            n += binCounts[b];
+            rightArea[b] = acc.area();
+            rightCount[b] = n;
+        }
+
+        // Then from the left, combining both sides
+        acc = AABB();
+        n = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            acc.extend(binBoxes[b]);
+            n += binCounts[b];
+            if (n == 0 || rightCount[b+1] == 0)
+                continue;
+            double cost = BVH_TRAVERSAL_COST
+                + (acc.area() * n + rightArea[b+1] * rightCount[b+1]) / area;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b + 1;
+            }
+        }
+    }
+
+    unsigned int mid;
+    if (bestAxis < 0)
+    {
+        // All centroids are the same: no split tells them apart
+        if (count <= BVH_MAX_LEAF_SIZE)
+            return index;
+        mid = begin + count / 2;
+    }
+    else
+    {
+        // Keep a leaf when splitting isn't worth it
+        if (bestCost >= count && count <= BVH_MAX_LEAF_SIZE)
+            return index;
+
+        double cMin = centroidBox.min.data[bestAxis];
+        double extent = centroidBox.max.data[bestAxis] - cMin;
+        unsigned int* split = std::partition(&indices[begin], &indices[0] + end,
+            [&](unsigned int i)
+            {
+                int b = (int)(BVH_BINS * (centroids[i].data[bestAxis] - cMin) / extent);
+                if (b >= BVH_BINS) b = BVH_BINS - 1;
+                return b < bestSplit;
+            });
+        mid = split - &indices[0];
+        if (mid == begin || mid == end)
+            mid = begin + count / 2;
+    }
+
+    out[index].count = 0;
+    auto build = [&](unsigned int begin, unsigned int end, int depth, std::vector<Node>& out)
+    {
+        return buildNode(boxes, centroids, begin, end, depth, out);
+    };
+    buildChildren(out, index, begin, mid, end, depth, build);
+    return index;
+}
+
+/************************** Linear BVH **********************************/
+
+// Spreads the 10 lowest bits of x two bits apart, so that the bits of three
+// coordinates can be interleaved
+static unsigned int spreadBits(unsigned int x)
+{
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x <<  8)) & 0x0300F00F;
+    x = (x | (x <<  4)) & 0x030C30C3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+MortonCurve::MortonCurve(const AABB& box) : min(box.min)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = box.max.data[axis] - box.min.data[axis];
+        scale[axis] = extent > 0 ? 1024.0 / extent : 0.0;
+    }
+}
+
+unsigned int MortonCurve::code(const Point& p) const
+{
+    unsigned int code = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double x = (p.data[axis] - min.data[axis]) * scale[axis];
+        unsigned int q = x > 0 ? (unsigned int)x : 0;
+        code |= spreadBits(q > 1023 ? 1023 : q) << (2 - axis);
+    }
+    return code;
+}
+
+void BVH::buildLinear(const std::vector<AABB>& boxes, int numThreads)
+{
+    // The primitives are handled in one contiguous chunk per thread
+    unsigned int count = boxes.size();
+    int chunks = numThreads > 1 && count >= BVH_PARALLEL_SIZE ? numThreads : 1;
+    auto chunkBegin = [&](int c) { return (unsigned int)((unsigned long long)count * c / chunks); };
+
+    // Bounds of the centroids, which the codes are relative to
+    std::vector<AABB> chunkBoxes(chunks);
+    TileScheduler::parallelFor(chunks, chunks, [&](int c, int)
+    {
+        for (unsigned int i = chunkBegin(c); i < chunkBegin(c + 1); i++)
+            chunkBoxes[c].extend(boxes[i].centroid());
+    });
+    AABB centroidBox;
+    for (int c = 0; c < chunks; c++)
+        centroidBox.extend(chunkBoxes[c]);
+
+    // Morton code of every centroid. Sorting the codes orders the
+    // primitives along a curve that keeps neighbours in space close.
+    MortonCurve curve(centroidBox);
+    std::vector<unsigned int> codes(count);
+    TileScheduler::parallelFor(chunks, chunks, [&](int c, int)
+    {
+        for (unsigned int i = chunkBegin(c); i < chunkBegin(c + 1); i++)
+        {
+            codes[i] = curve.code(boxes[i].centroid());
+            indices[i] = i;
+        }
+    });
+
+    // Radix sort of the codes, 10 bits at a time. Every chunk counts its
+    // digits, then moves its entries after those of the same digit in the
+    // chunks before it, which keeps the sort stable.
+    const unsigned int RADIX = 1024;
+    std::vector<unsigned int> sortedCodes(count), sortedIndices(count);
+    std::vector<unsigned int> offsets(chunks * RADIX);
+    for (int shift = 0; shift < 30; shift += 10)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        TileScheduler::parallelFor(chunks, chunks, [&](int c, int)
+        {
+            for (unsigned int i = chunkBegin(c); i < chunkBegin(c + 1); i++)
+                offsets[c * RADIX + ((codes[i] >> shift) & (RADIX - 1))]++;
+        });
+        unsigned int sum = 0;
+        for (unsigned int digit = 0; digit < RADIX; digit++)
+            for (int c = 0; c < chunks; c++)
+            {
+                unsigned int n = offsets[c * RADIX + digit];
+                offsets[c * RADIX + digit] = sum;
+                sum += n;
+            }
+        TileScheduler::parallelFor(chunks, chunks, [&](int c, int)
+        {
+            for (unsigned int i = chunkBegin(c); i < chunkBegin(c + 1); i++)
+            {
+                unsigned int to = offsets[c * RADIX + ((codes[i] >> shift) & (RADIX - 1))]++;
+                sortedCodes[to] = codes[i];
+                sortedIndices[to] = indices[i];
+            }
+        });
+        codes.swap(sortedCodes);
+        indices.swap(sortedIndices);
+    }
+
+    buildLinearNode(boxes, codes, 0, count, 29, 0, nodes);
+}
+
+unsigned int BVH::buildLinearNode(const std::vector<AABB>& boxes,
+    const std::vector<unsigned int>& codes,
+    unsigned int begin, unsigned int end, int bit, int depth, std::vector<Node>& out)
+{
+    unsigned int index = out.size();
+    out.push_back(Node());
+    out[index].start = begin;
+    out[index].count = end - begin;
+
+    // The codes of the range are sorted and share all their bits above
+    // `bit`: the highest bit on which the first and the last differ splits
+    // it into the codes where it is 0, then those where it is 1.
+    unsigned int count = end - begin;
+    unsigned int mid = end;
+    if (count > LBVH_LEAF_SIZE && depth < MAX_DEPTH)
+    {
+        unsigned int differ = codes[begin] ^ codes[end - 1];
+        while (bit >= 0 && !((differ >> bit) & 1))
+            bit--;
+        if (bit >= 0)
+            mid = std::partition_point(codes.begin() + begin, codes.begin() + end,
+                [bit](unsigned int code) { return !((code >> bit) & 1); }) - codes.begin();
+        else if (count > BVH_MAX_LEAF_SIZE)
+            mid = begin + count / 2; // same code: no bit tells them apart
+    }
+
+    if (mid == end)
+    {
+        AABB box;
+        for (unsigned int i = begin; i < end; i++)
+            box.extend(boxes[indices[i]]);
+        out[index].box = box;
+        return index;
+    }
+
+    // Bounds are only known once the children are built
+    out[index].count = 0;
+    auto build = [&](unsigned int begin, unsigned int end, int depth, std::vector<Node>& out)
+    {
+        return buildLinearNode(boxes, codes, begin, end, bit - 1, depth, out);
+    };
+    buildChildren(out, index, begin, mid, end, depth, build);
+    AABB box = out[index + 1].box;
+    box.extend(out[out[index].start].box);
+    out[index].box = box;
+    return index;
+}
+
+/************************** Wide BVH **********************************/
+
+bool BVH::isValid(unsigned int numPrimitives) const
+{
+    // Children come after their parent in both layouts, so one pass in
+    // order finds the depth of every node
+    auto validLeaf = [&](unsigned int start, unsigned int count)
+    {
+        return start <= numPrimitives && count <= numPrimitives - start;
+    };
+    if (!wideNodes.empty())
+    {
+        std::vector<int> depth(wideNodes.size(), 0);
+        for (unsigned int n = 0; n < wideNodes.size(); n++)
+        {
+            const WideNode& node = wideNodes[n];
+            if (node.numChildren > WIDE_NODE_WIDTH || depth[n] > MAX_DEPTH)
+                return false;
+            for (int c = 0; c < node.numChildren; c++)
+            {
+                unsigned int child = node.child[c];
+                if (node.count[c] > 0)
+                {
+                    if (!validLeaf(child, node.count[c]))
+                        return false;
+                }
+                else if (child <= n || child >= wideNodes.size())
+                    return false;
+                else
+                    depth[child] = std::max(depth[child], depth[n] + 1);
+            }
+        }
+        return true;
+    }
+
+    std::vector<int> depth(nodes.size(), 0);
+    for (unsigned int n = 0; n < nodes.size(); n++)
+    {
+        const Node& node = nodes[n];
+        if (depth[n] > MAX_DEPTH)
+            return false;
+        if (node.count > 0)
+        {
+            if (!validLeaf(node.start, node.count))
+                return false;
+            continue;
+        }
+        // The left child follows its parent, the right one is further on
+        if (node.start <= n + 1 || node.start >= nodes.size())
+            return false;
+        depth[n + 1] = std::max(depth[n + 1], depth[n] + 1);
+        depth[node.start] = std::max(depth[node.start], depth[n] + 1);
+    }
+    return true;
+}
+
+bool BVH::collapse()
+{
+    // Leaves that big only come from the depth limit
+    for (unsigned int n = 0; n < nodes.size(); n++)
+        if (nodes[n].count > 0xFFFF)
+            return false;
+
+    wideNodes.clear();
+    if (nodes.empty())
+        return true;
+    wideBounds = nodes[0].box;
+    wideNodes.reserve(nodes.size() / 2 + 1);
+    collapseNode(0);
+    wideNodes.shrink_to_fit();
+    std::vector<Node>().swap(nodes);
+    return true;
+}
+
+unsigned int BVH::collapseNode(unsigned int index)
+{
+    unsigned int children[WIDE_NODE_WIDTH];
+    int n = 0;
+    if (nodes[index].count > 0)
+        children[n++] = index; // the root is a leaf
+    else
+    {
+        children[n++] = index + 1;
+        children[n++] = nodes[index].start;
+    }
+
+    // Replace the largest inner child by its own two children, while there
+    // is room: large boxes are the ones most rays go through.
+    while (n < WIDE_NODE_WIDTH)
+    {
+        int largest = -1;
+        double largestArea = -1.0;
+        for (int c = 0; c < n; c++)
+            if (nodes[children[c]].count == 0 && nodes[children[c]].box.area() > largestArea)
+            {
+                largest = c;
+                largestArea = nodes[children[c]].box.area();
+            }
+        if (largest < 0)
+            break;
+        unsigned int opened = children[largest];
+        children[largest] = opened + 1;
+        children[n++] = nodes[opened].start;
+    }
+
+    // Careful: wideNodes may be reallocated by the recursive calls
+    unsigned int wide = wideNodes.size();
+    wideNodes.push_back(WideNode());
+    wideNodes[wide].setBounds(nodes[index].box);
+    for (int c = 0; c < n; c++)
+    {
+        const Node& node = nodes[children[c]];
+        unsigned int child = node.count > 0 ? node.start : collapseNode(children[c]);
+        wideNodes[wide].addChild(node.box, child, node.count);
+    }
+    return wide;
+}
@@ -0,0 +1,553 @@
+//
+//  Framework for a raytracer
+//  File: bvh.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef BVH_H_FABIOUX_LEOBAL
+#define BVH_H_FABIOUX_LEOBAL
+
+#include <vector>
+#include "aabb.h"
+#include "light.h"
+#include "stats.h"
+#include "widenode.h"
+
+// Morton curve over a box: the code of a point is its three coordinates in
+// the box, quantized to 10 bits each, interleaved (30 bits). Points close in
+// space mostly get close codes, so sorting them by code groups neighbours.
+class MortonCurve
+{
+public:
+    MortonCurve(const AABB& box);
+
+    unsigned int code(const Point& p) const;
+
+private:
+    Point min;
+    double scale[3]; // 1024 over the extent of the box, 0 if it is flat
+};
+
+// Bounding volume hierarchy over a set of primitives, built with the surface
+// area heuristic (SAH) or along a Morton curve. The hierarchy only knows the
+// primitives through their bounding boxes: it stores indices into the
+// caller's array, and the caller intersects the primitives themselves when a
+// leaf is reached.
+class BVH
+{
+public:
+    // How the hierarchy is built: sah tries several splits of every node and
+    // keeps the cheapest one, which gives the best trees; lbvh sorts the
+    // primitives along a Morton curve and splits where the codes differ,
+    // which is several times faster but gives worse trees.
+    enum Builder {sah, lbvh};
+
+    // Nodes are stored depth-first: the left child of an inner node directly
+    // follows it, the right child is at index `start`.
+    struct Node
+    {
+        AABB box;
+        unsigned int start; // leaf: first entry in `indices`; inner: right child
+        unsigned int count; // number of primitives in a leaf, 0 for inner nodes
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> indices;
+
+    // Same hierarchy once collapsed (see collapse), stored depth-first from
+    // the root. Wide nodes do not store their own bounds, hence the root's.
+    std::vector<WideNode> wideNodes;
+    AABB wideBounds;
+
+    BVH() : parallelDepth(0) { }
+
+    // Builds the hierarchy over the primitives whose bounds are given, on up
+    // to numThreads threads.
+    void build(const std::vector<AABB>& boxes, Builder builder = sah, int numThreads = 1);
+
+    // Expected cost of a ray hitting the root box, in primitive tests: every
+    // node counts with the probability of the ray hitting it (its area over
+    // the root's), times the traversal cost for inner nodes or the number of
+    // primitives for leaves. Lower is better; only meaningful between trees
+    // over the same primitives.
+    double sahCost() const;
+
+    // Turns the binary hierarchy into one of WideNodes: every node takes the
+    // children of its largest inner children in their place, until it has
+    // WIDE_NODE_WIDTH of them. Leaves stay the same. The binary nodes are
+    // freed, and the traversals use the wide ones from then on. Returns
+    // false (and keeps the binary nodes) if a leaf is too large to be stored.
+    bool collapse();
+
+    bool isEmpty() const { return nodes.empty() && wideNodes.empty(); }
+
+    // Whether the nodes (binary or wide) make a hierarchy the traversals can
+    // walk: children after their parent and within the nodes, leaves within
+    // the numPrimitives primitives, no deeper than the builders go. For
+    // hierarchies read back from a file.
+    bool isValid(unsigned int numPrimitives) const;
+
+    // Bounds of all the primitives
+    AABB bounds() const
+    {
+        if (!wideNodes.empty())
+            return wideBounds;
+        return nodes.empty() ? AABB() : nodes[0].box;
+    }
+
+    // Walks the hierarchy along the ray, nearest nodes first, and calls
+    //     bool leaf(unsigned int primitive, double& tMax)
+    // for every primitive of every leaf whose box is hit before tMax.
+    // The callback can shrink tMax when it finds a closer hit, which prunes
+    // the rest of the traversal, and returns true to stop it altogether.
+    template <class Leaf>
+    void traverse(const Ray& ray, double tMax, Leaf& leaf) const;
+
+    // Same, but calls
+    //     bool leaf(unsigned int start, unsigned int count, double& tMax)
+    // once per leaf with its range, for callers that store the primitives
+    // of a leaf together and test them in one go.
+    template <class Leaf>
+    void traverseLeaves(const Ray& ray, double tMax, Leaf& leaf) const;
+
+    // Walks the hierarchy with all the rays of the packet at once, and calls
+    //     void leaf(unsigned int start, unsigned int count, int first, double* tMax)
+    // for every leaf hit by at least one of them. Rays before `first` are
+    // known to miss the leaf. tMax holds the bound of each ray, and the
+    // callback shrinks it as it finds closer hits.
+    template <class Leaf>
+    void traversePacket(const RayPacket& packet, double* tMax, Leaf& leaf) const;
+
+private:
+    static const int MAX_DEPTH = 60;
+
+    // Nodes above this depth build their right child on a thread of its own
+    int parallelDepth;
+
+    // Both builders add the subtree over indices [begin, end) to `out`,
+    // depth-first, and return the index of its root there.
+    unsigned int buildNode(const std::vector<AABB>& boxes,
+        const std::vector<Point>& centroids,
+        unsigned int begin, unsigned int end, int depth, std::vector<Node>& out);
+    unsigned int buildLinearNode(const std::vector<AABB>& boxes,
+        const std::vector<unsigned int>& codes,
+        unsigned int begin, unsigned int end, int bit, int depth, std::vector<Node>& out);
+    void buildLinear(const std::vector<AABB>& boxes, int numThreads);
+
+    // Builds both children of out[index], splitting its range at mid, with
+    //     unsigned int build(begin, end, depth, out)
+    template <class Build>
+    void buildChildren(std::vector<Node>& out, unsigned int index,
+        unsigned int begin, unsigned int mid, unsigned int end, int depth, Build& build);
+
+    // Adds the wide node standing for the binary node index, and the wide
+    // nodes below it. Returns its index.
+    unsigned int collapseNode(unsigned int index);
+
+    template <class Leaf>
+    void traverseWide(const Ray& ray, double tMax, Leaf& leaf) const;
+    template <class Leaf>
+    void traversePacketWide(const RayPacket& packet, double* tMax, Leaf& leaf) const;
+};
+
+
+template <class Leaf>
+void BVH::traverse(const Ray& ray, double tMax, Leaf& leaf) const
+{
+    auto primitives = [&](unsigned int start, unsigned int count, double& tMax)
+    {
+        for (unsigned int i = start; i < start + count; i++)
+            if (leaf(indices[i], tMax))
+                return true;
+        return false;
+    };
+    traverseLeaves(ray, tMax, primitives);
+}
+
+template <class Leaf>
+void BVH::traverseLeaves(const Ray& ray, double tMax, Leaf& leaf) const
+{
+    if (!wideNodes.empty())
+    {
+        traverseWide(ray, tMax, leaf);
+        return;
+    }
+    if (nodes.empty())
+        return;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+
+    // Nodes still to visit, with their entry distance along the ray
+    unsigned int stack[MAX_DEPTH + 4];
+    double stackNear[MAX_DEPTH + 4];
+    int top = 0;
+
+    double tNear;
+    if (!nodes[0].box.intersect(ray.O, invD, tMax, tNear))
+        return;
+
+    unsigned int current = 0;
+    long long visited = 0;
+    while (true)
+    {
+        const Node& node = nodes[current];
+        visited++;
+        if (node.count > 0)
+        {
+            if (leaf(node.start, node.count, tMax))
+            {
+                RenderStats::countNodes(visited);
+                return;
+            }
+        }
+        else
+        {
+            unsigned int left = current + 1;
+            unsigned int right = node.start;
+            double tLeft, tRight;
+            bool hitLeft = nodes[left].box.intersect(ray.O, invD, tMax, tLeft);
+            bool hitRight = nodes[right].box.intersect(ray.O, invD, tMax, tRight);
+
+            if (hitLeft && hitRight)
+            {
+                // Visit the nearest child first, keep the other one for later
+                if (tRight < tLeft)
+                {
+                    stack[top] = left;
+                    stackNear[top++] = tLeft;
+                    current = right;
+                }
+                else
+                {
+                    stack[top] = right;
+                    stackNear[top++] = tRight;
+                    current = left;
+                }
+                continue;
+            }
+            if (hitLeft)  { current = left; continue; }
+            if (hitRight) { current = right; continue; }
+        }
+
+        // Pop the next node that can still hold a closer hit
+        do
+        {
+            if (top == 0)
+            {
+                RenderStats::countNodes(visited);
+                return;
+            }
+            --top;
+        } while (stackNear[top] > tMax);
+        current = stack[top];
+    }
+}
+
+template <class Leaf>
+void BVH::traversePacket(const RayPacket& packet, double* tMax, Leaf& leaf) const
+{
+    if (!wideNodes.empty() && packet.size > 0)
+    {
+        traversePacketWide(packet, tMax, leaf);
+        return;
+    }
+    if (nodes.empty() || packet.size == 0)
+        return;
+
+    Vector invD[RayPacket::MAX_SIZE];
+    for (int i = 0; i < packet.size; i++)
+        invD[i] = Vector(1.0 / packet.rays[i]->D.x, 1.0 / packet.rays[i]->D.y, 1.0 / packet.rays[i]->D.z);
+
+    // Index of the first ray of the packet that hits the box, starting from
+    // ray `from`, or packet.size if none does. The rays of the packet being
+    // close to each other, it usually is the first one tested.
+    auto firstHit = [&](const AABB& box, int from, double& tNear)
+    {
+        for (int i = from; i < packet.size; i++)
+            if (box.intersect(packet.rays[i]->O, invD[i], tMax[i], tNear))
+                return i;
+        return packet.size;
+    };
+
+    // Nodes still to visit, with the first ray known to hit them
+    unsigned int stack[MAX_DEPTH + 4];
+    int stackFirst[MAX_DEPTH + 4];
+    int top = 0;
+
+    double tNear;
+    int first = firstHit(nodes[0].box, 0, tNear);
+    if (first == packet.size)
+        return;
+
+    unsigned int current = 0;
+    long long visited = 0;
+    while (true)
+    {
+        const Node& node = nodes[current];
+        visited++;
+        if (node.count > 0)
+            leaf(node.start, node.count, first, tMax);
+        else
+        {
+            unsigned int left = current + 1;
+            unsigned int right = node.start;
+            double tLeft, tRight;
+            int firstLeft = firstHit(nodes[left].box, first, tLeft);
+            int firstRight = firstHit(nodes[right].box, first, tRight);
+
+            if (firstLeft < packet.size && firstRight < packet.size)
+            {
+                // Visit the nearest child first, as seen from the first ray
+                // hitting both
+                bool rightFirst = firstLeft == firstRight ? tRight < tLeft : firstRight < firstLeft;
+                if (rightFirst)
+                {
+                    stack[top] = left;
+                    stackFirst[top++] = firstLeft;
+                    current = right;
+                    first = firstRight;
+                }
+                else
+                {
+                    stack[top] = right;
+                    stackFirst[top++] = firstRight;
+                    current = left;
+                    first = firstLeft;
+                }
+                continue;
+            }
+            if (firstLeft < packet.size)  { current = left; first = firstLeft; continue; }
+            if (firstRight < packet.size) { current = right; first = firstRight; continue; }
+        }
+
+        // Pop the next node that some ray can still hit before its bound
+        do
+        {
+            if (top == 0)
+            {
+                RenderStats::countNodes(visited);
+                return;
+            }
+            --top;
+            first = firstHit(nodes[stack[top]].box, stackFirst[top], tNear);
+        } while (first == packet.size);
+        current = stack[top];
+    }
+}
+
+template <class Leaf>
+void BVH::traverseWide(const Ray& ray, double tMax, Leaf& leaf) const
+{
+    WideRay wideRay(ray);
+    float tBound = WideRay::bound(tMax);
+
+    // Children still to visit (nodes or leaves), with their entry distance
+    // along the ray
+    struct Entry
+    {
+        unsigned int child, count;
+        float tNear;
+    };
+    Entry stack[(WIDE_NODE_WIDTH - 1) * (MAX_DEPTH + 1) + 4];
+    int top = 0;
+
+    Entry current = { 0, 0, 0.0f };
+    long long visited = 0;
+    while (true)
+    {
+        if (current.count > 0)
+        {
+            if (leaf(current.child, current.count, tMax))
+            {
+                RenderStats::countNodes(visited);
+                return;
+            }
+            tBound = WideRay::bound(tMax);
+        }
+        else
+        {
+            const WideNode& node = wideNodes[current.child];
+            visited++;
+            float tNear[WIDE_NODE_WIDTH];
+            int hits = node.intersect(wideRay, tBound, tNear);
+            if (hits)
+            {
+                // Sort the children hit from the farthest to the nearest,
+                // keep all but the nearest for later and visit it
+                int order[WIDE_NODE_WIDTH], n = 0;
+                for (int c = 0; c < WIDE_NODE_WIDTH; c++)
+                {
+                    if (!(hits & (1 << c)))
+                        continue;
+                    int k = n++;
+                    for (; k > 0 && tNear[order[k-1]] < tNear[c]; k--)
+                        order[k] = order[k-1];
+                    order[k] = c;
+                }
+                for (int k = 0; k < n - 1; k++)
+                {
+                    stack[top].child = node.child[order[k]];
+                    stack[top].count = node.count[order[k]];
+                    stack[top++].tNear = tNear[order[k]];
+                }
+                current.child = node.child[order[n-1]];
+                current.count = node.count[order[n-1]];
+                continue;
+            }
+        }
+
+        // Pop the next child that can still hold a closer hit
+        do
+        {
+            if (top == 0)
+            {
+                RenderStats::countNodes(visited);
+                return;
+            }
+            --top;
+        } while (stack[top].tNear > tBound);
+        current = stack[top];
+    }
+}
+
+template <class Leaf>
+void BVH::traversePacketWide(const RayPacket& packet, double* tMax, Leaf& leaf) const
+{
+    WideRay rays[RayPacket::MAX_SIZE];
+    for (int i = 0; i < packet.size; i++)
+        rays[i] = WideRay(*packet.rays[i]);
+
+    // Children missed by the bounds of the packet are missed by all its
+    // rays: they are rejected without testing the rays one by one.
+    WidePacket bounds(rays, packet.size);
+    auto packetBound = [&]()
+    {
+        double t = 0.0;
+        for (int i = 0; i < packet.size; i++)
+            t = tMax[i] > t ? tMax[i] : t;
+        return WideRay::bound(t);
+    };
+    float tPacket = packetBound();
+
+    // Children still to visit, with the first ray known to hit them, and
+    // the node and slot they are in, to test them again when popped
+    struct Entry
+    {
+        unsigned int child, count;
+        int first;
+        unsigned int parent;
+        int slot;
+    };
+    Entry stack[(WIDE_NODE_WIDTH - 1) * (MAX_DEPTH + 1) + 4];
+    int top = 0;
+
+    // Index of the first ray of the packet that still hits the child of the
+    // entry, starting from its first one, or packet.size if none does
+    auto firstHit = [&](const Entry& entry)
+    {
+        float tNear[WIDE_NODE_WIDTH];
+        for (int i = entry.first; i < packet.size; i++)
+            if (wideNodes[entry.parent].intersect(rays[i], WideRay::bound(tMax[i]), tNear) & (1 << entry.slot))
+                return i;
+        return packet.size;
+    };
+
+    Entry current = { 0, 0, 0, 0, 0 };
+    long long visited = 0;
+    while (true)
+    {
+        if (current.count > 0)
+        {
+            leaf(current.child, current.count, current.first, tMax);
+            tPacket = packetBound();
+        }
+        else
+        {
+            const WideNode& node = wideNodes[current.child];
+            visited++;
+
+            // First ray hitting each child, and where it enters it
+            int first[WIDE_NODE_WIDTH];
+            float tFirst[WIDE_NODE_WIDTH];
+            int pending = bounds.coherent ? node.intersect(bounds, tPacket) : (1 << node.numChildren) - 1;
+            int hits = 0;
+            for (int i = current.first; i < packet.size && pending; i++)
+            {
+                float tNear[WIDE_NODE_WIDTH];
+                int found = node.intersect(rays[i], WideRay::bound(tMax[i]), tNear) & pending;
+                for (int c = 0; c < WIDE_NODE_WIDTH; c++)
+                    if (found & (1 << c))
+                    {
+                        first[c] = i;
+                        tFirst[c] = tNear[c];
+                    }
+                pending &= ~found;
+                hits |= found;
+            }
+
+            if (hits)
+            {
+                // Visit the child hit by the earliest ray first (the nearest
+                // one for that ray on a tie), keep the others for later
+                auto later = [&](int a, int b)
+                {
+                    return first[a] != first[b] ? first[a] > first[b] : tFirst[a] > tFirst[b];
+                };
+                int order[WIDE_NODE_WIDTH], n = 0;
+                for (int c = 0; c < WIDE_NODE_WIDTH; c++)
+                {
+                    if (!(hits & (1 << c)))
+                        continue;
+                    int k = n++;
+                    for (; k > 0 && later(c, order[k-1]); k--)
+                        order[k] = order[k-1];
+                    order[k] = c;
+                }
+                for (int k = 0; k < n - 1; k++)
+                {
+                    Entry& entry = stack[top++];
+                    entry.child = node.child[order[k]];
+                    entry.count = node.count[order[k]];
+                    entry.first = first[order[k]];
+                    entry.parent = current.child;
+                    entry.slot = order[k];
+                }
+                int c = order[n-1];
+                current.first = first[c];
+                current.count = node.count[c];
+                current.child = node.child[c];
+                continue;
+            }
+        }
+
+        // Pop the next child that some ray can still hit before its bound
+        do
+        {
+            if (top == 0)
+            {
+                RenderStats::countNodes(visited);
+                return;
+            }
+            --top;
+            stack[top].first = firstHit(stack[top]);
+        } while (stack[top].first == packet.size);
+        current = stack[top];
+    }
+}
+
+#endif /* end of include guard: BVH_H_FABIOUX_LEOBAL */
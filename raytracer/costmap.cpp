@@ -0,0 +1,97 @@
+//
+//  Framework for a raytracer
+//  File: costmap.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "costmap.h"
+#include <algorithm>
+#include <math.h>
+
+// Colour of x in [0, 1], interpolated between a few steps
+static Color palette(double x)
+{
+    static const Color steps[] = {
+        Color(0, 0, 0), Color(0.15, 0.05, 0.6), Color(0.8, 0.1, 0.35),
+        Color(1, 0.6, 0), Color(1, 1, 1)
+    };
+    const int last = sizeof(steps) / sizeof(steps[0]) - 1;
+
+    x = std::min(std::max(x, 0.0), 1.0) * last;
+    int i = std::min((int)x, last - 1);
+    double f = x - i;
+    return steps[i] * (1 - f) + steps[i+1] * f;
+}
+
+void drawCostMap(Image &img, const std::vector<double> &cost, bool logScale, bool legend,
+    double &lowest, double &highest)
+{
+    int w = img.width();
+    int h = img.height();
+
+    std::vector<double> sorted(cost);
+    std::vector<double>::iterator top = sorted.begin() + (sorted.size() - 1) * 999 / 1000;
+    std::nth_element(sorted.begin(), top, sorted.end());
+    highest = *top;
+    lowest = *std::min_element(sorted.begin(), sorted.end());
+    double range = highest - lowest;
+
+    // Position of a cost on the scale, in [0, 1]
+    auto scale = [&](double c)
+    {
+        if (range <= 0)
+            return 0.0;
+        c = std::min(c - lowest, range);
+        return logScale ? log1p(c) / log1p(range) : c / range;
+    };
+
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            img(x,y) = palette(scale(cost[y*w + x]));
+
+    if (!legend || w < 2)
+        return;
+
+    // The bar, under a black line separating it from the picture
+    int barHeight = std::min(std::max(h / 24, 8), h - 1);
+    for (int x = 0; x < w; x++)
+    {
+        Color c = palette((double)x / (w - 1));
+        img(x, h - barHeight - 1) = Color(0, 0, 0);
+        for (int y = h - barHeight; y < h; y++)
+            img(x,y) = c;
+    }
+
+    // Ticks over the top half of the bar, dark on the bright part of the
+    // scale and bright on the dark one
+    std::vector<double> ticks;
+    if (logScale)
+        for (double t = 1; t <= range; t *= 10)
+            ticks.push_back(lowest + t);
+    else
+        for (int i = 1; i < 10; i++)
+            ticks.push_back(lowest + range * i / 10);
+    for (unsigned int i = 0; i < ticks.size(); i++)
+    {
+        double position = scale(ticks[i]);
+        int x = std::min((int)(position * (w - 1) + 0.5), w - 1);
+        Color c = position > 0.5 ? Color(0, 0, 0) : Color(1, 1, 1);
+        for (int y = h - barHeight; y < h - barHeight / 2; y++)
+            img(x,y) = c;
+    }
+}
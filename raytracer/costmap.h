@@ -0,0 +1,40 @@
+//
+//  Framework for a raytracer
+//  File: costmap.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef COSTMAP_H_FABIOUX_LEOBAL
+#define COSTMAP_H_FABIOUX_LEOBAL
+
+#include <vector>
+#include "image.h"
+
+// Replaces img by a false colour picture of cost (one value per pixel, row
+// by row): black for the lowest cost, then blue, red, orange and white for
+// the highest. The highest is taken at the 99.9th percentile, so that a few
+// outliers (a thread preempted in the middle of a pixel) do not squash the
+// scale; costlier pixels are white too. With logScale, colours follow
+// log(1 + cost - lowest), so that a few very expensive pixels do not leave
+// all the others black. With legend, the scale is drawn along the bottom of
+// the image, with a tick at every power of 10 above the lowest (log scale)
+// or at every tenth of the scale (linear scale).
+void drawCostMap(Image &img, const std::vector<double> &cost, bool logScale, bool legend,
+    double &lowest, double &highest);
+
+#endif /* end of include guard: COSTMAP_H_FABIOUX_LEOBAL */
@@ -20,11 +20,14 @@
 //
 
 #include "cylinder.h"
+#include "stats.h"
 #include <math.h>
 
 
 Hit Cylinder::intersect(const Ray &ray)
 {
+	RenderStats::countTests(RenderCounters::cylinders);
+
 	// intersection with circular borders
 	
 	Vector axis = p1 - p0 ;
@@ -59,28 +62,28 @@ Hit Cylinder::intersect(const Ray &ray)
 		otherSol = x1;
 	}	
 	
-	if (rightSol < 0)
-		return Hit::NO_HIT();
-	
-	// check whether the point is indeed inside the boundaries of the cylinder
-	
-	Vector z0 = Vector(p0 - ray.at(rightSol)).normalized();
-	Vector z1 = Vector(p1 - ray.at(rightSol)).normalized();
-	
-	if (z0.dot(p0-p1) >= 0 && z1.dot(p1-p0) >= 0)
-		return Hit(rightSol, (ray.O + ray.D*rightSol - p0).normalized());
-	
-	else
+	// A ray refracted into the cylinder is inside: it leaves by the far
+	// side, the near solution being the point it starts from. Solutions
+	// closer than EPSILON are that point again, rounded.
+	const double EPSILON = 0.0000001;
+	double solutions[2] = { rightSol, otherSol };
+	for (int i = ray.isInside(this) ? 1 : 0; i < 2; i++)
 	{
-		if (otherSol < 0)
-			return Hit::NO_HIT();
-		z0 = Vector(p0 - ray.at(otherSol)).normalized();
-		z1 = Vector(p1 - ray.at(otherSol)).normalized();
+		double t = solutions[i];
+		if (t <= EPSILON)
+			continue;
+
+		// check whether the point is indeed inside the boundaries of the cylinder
+		Vector z0 = Vector(p0 - ray.at(t)).normalized();
+		Vector z1 = Vector(p1 - ray.at(t)).normalized();
 		if (z0.dot(p0-p1) >= 0 && z1.dot(p1-p0) >= 0)
-			return Hit(otherSol, (ray.O + ray.D*otherSol - p0).normalized());
-		else
-			return Hit::NO_HIT();
+		{
+			// The normal is the part of p0->hit across the axis
+			Vector v = ray.at(t) - p0;
+			return Hit(t, (v - (v.dot(axis)/axis.dot(axis)) * axis).normalized());
+		}
 	}
+	return Hit::NO_HIT();
 }
 
 
@@ -93,3 +96,12 @@ bool Cylinder::hasWithin(Point p)
 		return true;
 	return false;
 }
+
+AABB Cylinder::bounds()
+{
+	// Conservative: the box around both end points, grown by the radius
+	AABB box;
+	box.extend(p0);
+	box.extend(p1);
+	return AABB(box.min - r, box.max + r);
+}
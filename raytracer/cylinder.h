@@ -31,6 +31,7 @@ public:
 
     virtual Hit intersect(const Ray &ray);
     virtual bool hasWithin(Point p);
+    virtual AABB bounds();
 
     const Point p0, p1;
     const double r;
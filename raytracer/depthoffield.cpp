@@ -0,0 +1,237 @@
+//
+//  Framework for a raytracer
+//  File: depthoffield.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "depthoffield.h"
+#include <algorithm>
+#include <math.h>
+#include "scheduler.h"
+
+#define DOF_TILE_SIZE 16
+#define DOF_MAX_BAND 12
+
+namespace {
+
+// Summed-area table of some pixels of an image: sums of the colours and
+// number of the selected pixels in the rectangle from (0, 0) to every pixel.
+class SummedArea
+{
+public:
+    SummedArea(int w, int h) : w(w), h(h), sums((w+1)*(h+1)), counts((w+1)*(h+1), 0.0) { }
+
+    void build(const Image &img, const std::vector<char> &selected, int numThreads)
+    {
+        // Rows then columns, each in parallel. Row and column 0 stay null.
+        TileScheduler::parallelFor(numThreads, h, [&](int y, int)
+        {
+            Color sum(0.0, 0.0, 0.0);
+            double count = 0;
+            for (int x = 0; x < w; x++)
+            {
+                if (selected[y*w + x])
+                {
+                    sum += img(x, y);
+                    count += 1;
+                }
+                sums[at(x+1, y+1)] = sum;
+                counts[at(x+1, y+1)] = count;
+            }
+        });
+        TileScheduler::parallelFor(numThreads, w, [&](int x, int)
+        {
+            for (int y = 1; y < h; y++)
+            {
+                sums[at(x+1, y+1)] += sums[at(x+1, y)];
+                counts[at(x+1, y+1)] += counts[at(x+1, y)];
+            }
+        });
+    }
+
+    // Sum and number of the selected pixels, and total number of pixels, in
+    // the square of half-size a around (x, y), clipped to the image.
+    // Non-integer sizes are interpolated between the two nearest squares.
+    void gather(int x, int y, double a, Color &sum, double &count, double &area) const
+    {
+        int a0 = (int)a;
+        double f = a - a0;
+        box(x, y, a0, sum, count, area);
+        if (f > 0)
+        {
+            Color sum1;
+            double count1, area1;
+            box(x, y, a0+1, sum1, count1, area1);
+            sum = sum * (1-f) + sum1 * f;
+            count = count * (1-f) + count1 * f;
+            area = area * (1-f) + area1 * f;
+        }
+    }
+
+private:
+    int w, h;
+    std::vector<Color> sums;
+    std::vector<double> counts;
+
+    int at(int x, int y) const { return y*(w+1) + x; }
+
+    void box(int x, int y, int a, Color &sum, double &count, double &area) const
+    {
+        int x0 = std::max(x-a, 0), y0 = std::max(y-a, 0);
+        int x1 = std::min(x+a+1, w), y1 = std::min(y+a+1, h);
+        sum = sums[at(x1, y1)] - sums[at(x0, y1)] - sums[at(x1, y0)] + sums[at(x0, y0)];
+        count = counts[at(x1, y1)] - counts[at(x0, y1)] - counts[at(x1, y0)] + counts[at(x0, y0)];
+        area = (x1-x0) * (y1-y0);
+    }
+};
+
+// Band of a circle of confusion: 0 below 2 pixels, then one per power of two
+int band(float coc)
+{
+    if (coc < 2)
+        return 0;
+    return std::min((int)log2(coc), DOF_MAX_BAND);
+}
+
+}
+
+void depthOfField(Image &img, const std::vector<float> &coc, const std::vector<char> &nearField, int numThreads)
+{
+    int w = img.width(), h = img.height();
+    int tw = (w + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE, th = (h + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+
+    // A square of half-size a has the same area as a disk of radius
+    // a * 2 / sqrt(pi)
+    const double squareSize = sqrt(M_PI) / 2;
+
+    // Pixels in front of the focus plane but sharp belong with the ones
+    // behind: they hide them, and do not spread over anything.
+    std::vector<char> front(w*h);
+    std::vector<int> bands(w*h);
+    int numBands = DOF_MAX_BAND + 1;
+    std::vector<int> frontCount(numBands, 0), backCount(numBands, 0);
+    std::vector<double> frontCoc(numBands, 0.0);
+    for (int i = 0; i < w*h; i++)
+    {
+        front[i] = nearField[i] && coc[i] * squareSize >= 1;
+        bands[i] = band(coc[i]);
+        if (front[i])
+        {
+            frontCount[bands[i]]++;
+            frontCoc[bands[i]] += coc[i];
+        }
+        else
+            backCount[bands[i]]++;
+    }
+
+    // Results go to a separate buffer, the tables are built from img
+    std::vector<Color> result(w*h);
+    SummedArea sums(w, h), previous(w, h);
+    std::vector<char> selected(w*h, 0);
+
+    // Behind the focus plane, from the blurriest band to the sharpest: once
+    // a band is added, its pixels average everything at least as blurry.
+    for (int b = numBands - 1; b >= 0; b--)
+    {
+        if (backCount[b] == 0)
+            continue;
+        for (int i = 0; i < w*h; i++)
+            if (!front[i] && bands[i] == b)
+                selected[i] = 1;
+        sums.build(img, selected, numThreads);
+
+        TileScheduler::parallelFor(numThreads, h, [&](int y, int)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                int i = y*w + x;
+                if (front[i] || bands[i] != b)
+                    continue;
+                Color sum;
+                double count, area;
+                sums.gather(x, y, coc[i] * squareSize, sum, count, area);
+                result[i] = sum / count;
+            }
+        });
+    }
+
+    // In front of the focus plane, from the sharpest band to the blurriest.
+    // Each band's pixels average the pixels of the band, and the band is laid
+    // over everything behind it, in proportion to how many of its pixels are
+    // around.
+    std::fill(selected.begin(), selected.end(), 0);
+    sums.build(img, selected, numThreads);
+    std::vector<char> tiles(tw*th);
+    for (int b = 0; b < numBands; b++)
+    {
+        if (frontCount[b] == 0)
+            continue;
+        for (int i = 0; i < w*h; i++)
+            if (front[i] && bands[i] == b)
+                selected[i] = 1;
+        std::swap(sums, previous);
+        sums.build(img, selected, numThreads);
+
+        // Tiles this band can reach, with squares of its mean size
+        double size = frontCoc[b] / frontCount[b] * squareSize;
+        int reach = (int)ceil((size + 1) / DOF_TILE_SIZE);
+        std::fill(tiles.begin(), tiles.end(), 0);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                if (front[y*w + x] && bands[y*w + x] == b)
+                {
+                    int tx = x / DOF_TILE_SIZE, ty = y / DOF_TILE_SIZE;
+                    for (int ny = std::max(ty - reach, 0); ny <= std::min(ty + reach, th - 1); ny++)
+                        for (int nx = std::max(tx - reach, 0); nx <= std::min(tx + reach, tw - 1); nx++)
+                            tiles[ny*tw + nx] = 1;
+                    x = (tx + 1) * DOF_TILE_SIZE - 1; // rest of the tile is done
+                }
+
+        TileScheduler::parallelFor(numThreads, h, [&](int y, int)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                int i = y*w + x;
+                bool own = front[i] && bands[i] == b;
+                if (!own && ((front[i] && bands[i] > b) || !tiles[(y / DOF_TILE_SIZE) * tw + x / DOF_TILE_SIZE]))
+                    continue;
+
+                // The band alone is the difference with the table without it
+                double a = own ? coc[i] * squareSize : size;
+                Color sum, sumBefore;
+                double count, area, countBefore;
+                sums.gather(x, y, a, sum, count, area);
+                previous.gather(x, y, a, sumBefore, countBefore, area);
+                sum -= sumBefore;
+                count -= countBefore;
+
+                if (own)
+                    result[i] = count > 1e-6 ? sum / count : img(x, y);
+                else if (count > 1e-6)
+                {
+                    double coverage = count / area;
+                    result[i] = result[i] * (1 - coverage) + (sum / count) * coverage;
+                }
+            }
+        });
+    }
+
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            img(x, y) = result[y*w + x];
+}
@@ -0,0 +1,42 @@
+//
+//  Framework for a raytracer
+//  File: depthoffield.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef DEPTHOFFIELD_H_FABIOUX_LEOBAL
+#define DEPTHOFFIELD_H_FABIOUX_LEOBAL
+
+#include <vector>
+#include "image.h"
+
+// Blurs img in place to simulate a lens. coc is the radius of the circle of
+// confusion of every pixel (in pixels, row by row), and nearField tells
+// whether the pixel is in front of the focus plane.
+//
+// Rather than drawing a disk per pixel, every pixel gathers the average of a
+// square of the same area as its circle from a summed-area table, so that the
+// cost does not depend on the amount of blur. Pixels are sorted by size of
+// circle (one band per power of two): a pixel behind the focus plane only
+// averages pixels at least as blurry as itself, so sharp objects do not leak
+// into the background, and each band of blurry foreground is then laid over
+// what is behind it, nearest last. 16x16 tiles keep track of where each band
+// can reach, so that pixels far from it skip it.
+void depthOfField(Image &img, const std::vector<float> &coc, const std::vector<char> &nearField, int numThreads);
+
+#endif /* end of include guard: DEPTHOFFIELD_H_FABIOUX_LEOBAL */
@@ -316,6 +316,10 @@ glmReadMTL(GLMmodel* model, char* name)
     model->materials[i].specular[1] = 0.0;
     model->materials[i].specular[2] = 0.0;
     model->materials[i].specular[3] = 1.0;
+    model->materials[i].emmissive[0] = 0.0;
+    model->materials[i].emmissive[1] = 0.0;
+    model->materials[i].emmissive[2] = 0.0;
+    model->materials[i].emmissive[3] = 1.0;
   }
   model->materials[0].name = strdup("default");
 
@@ -359,6 +363,12 @@ glmReadMTL(GLMmodel* model, char* name)
 	       &model->materials[nummaterials].ambient[1],
 	       &model->materials[nummaterials].ambient[2]);
 	break;
+      case 'e':
+	fscanf(file, "%f %f %f",
+	       &model->materials[nummaterials].emmissive[0],
+	       &model->materials[nummaterials].emmissive[1],
+	       &model->materials[nummaterials].emmissive[2]);
+	break;
       default:
 	/* eat up rest of line */
 	fgets(buf, sizeof(buf), file);
@@ -19,6 +19,7 @@
 
 #include "image.h"
 #include "lodepng.h"
+#include "postprocess.h"
 #include <fstream>
 
 /*
@@ -123,36 +124,19 @@ void Image::fill(Color c)
 			(*this)(x, y) = c;
 }
 
-void Image::overlay(Image img, double multiplier, bool clamp)
+void Image::overlay(const Image &img, double multiplier, bool clamp)
 {
-	if (height() != img.height() || width() != img.width())
-		throw new string("Not the same dimensions !");
-	
-	
-	for (int y = 0 ; y < _height ; y++)
-		for (int x = 0 ; x < _width ; x++)
-		{
-			(*this)(x,y)+=(multiplier*img.get_pixel(x,y));
-			if (clamp)
-				(*this)(x,y).clamp();
-		}
-	
+	PostProcess post;
+	post.addOverlay(img, multiplier);
+	if (clamp)
+		post.addClamp();
+	post.apply(*this);
 }
 
 
 double Image::toneMap(double x)
 {
-	if (x < 0.6)
-		return x;
-	else
-	{
-		double res= (0.6+0.45333-(0.45333*0.45333/(x-0.6+0.45333)));
-		std::cout << "res : "<<res <<std::endl;
-		if (res < 1)
-			return res;
-		else
-			return 1;
-	}
+	return PostProcess::toneMap(x);
 }
 
 /**
@@ -160,16 +144,8 @@ double Image::toneMap(double x)
  */
 void Image::smartClamp()
 {
-	for (int y = 0 ; y < _height ; y++)
-		for (int x = 0 ; x < _width ; x++)
-		{
-			std::cout << (*this)(x,y).r << " " << (*this)(x,y).g << " " <<(*this)(x,y).b << std::endl;
-			(*this)(x,y).r = toneMap((*this)(x,y).r);
-			(*this)(x,y).g = toneMap((*this)(x,y).g);
-			(*this)(x,y).b = toneMap((*this)(x,y).b);
-			std::cout << (*this)(x,y).r << " " << (*this)(x,y).g << " " <<(*this)(x,y).b << std::endl <<std::endl;
-			
-		}
+	PostProcess post;
+	post.addToneMap();
+	post.apply(*this);
 }
 
-
@@ -79,7 +79,7 @@ public:
     // complex operations
     void addCircle(int x, int y, Color c, int radius, bool clamp=false);
     void fill(Color c);
-    void overlay(Image img, double multiplier=1, bool clamp=false);
+    void overlay(const Image &img, double multiplier=1, bool clamp=false);
     void smartClamp();
     double toneMap(double);
 
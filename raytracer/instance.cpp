@@ -0,0 +1,84 @@
+//
+//  Framework for a raytracer
+//  File: instance.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "instance.h"
+
+Instance::Instance(Object* object, const Transform& toWorld)
+    : object(object), toWorld(toWorld)
+{
+    toWorld.inverse(toObject);
+
+    // Cube root of the volume scale, exact for uniform scales
+    const double (*m)[4] = toObject.m;
+    double determinant = m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+        - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+        + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+    footprintScale = cbrt(fabs(determinant));
+}
+
+Ray Instance::localRay(const Ray &ray, double &scale) const
+{
+    Vector D = toObject.vector(ray.D);
+    scale = D.length();
+
+    // The object sees the ray start from itself when it starts from the
+    // instance, so that meshes skip the face it leaves, and spheres know
+    // when it is inside
+    Ray local(toObject.point(ray.O), D / scale, ray.origin == this ? object : NULL);
+    local.originFace = ray.originFace;
+    if (ray.isInside(this))
+        local.enter(object);
+    return local;
+}
+
+Hit Instance::intersect(const Ray &ray)
+{
+    double scale;
+    Hit hit(object->intersect(localRay(ray, scale)));
+    if (hit.no_hit)
+        return hit;
+
+    hit.t /= scale;
+    hit.N = toObject.transposedVector(hit.N).normalized();
+    return hit;
+}
+
+bool Instance::occludes(const Ray &ray, double maxDistance)
+{
+    double scale;
+    Ray local(localRay(ray, scale));
+    return object->occludes(local, maxDistance * scale);
+}
+
+Color Instance::surfaceColor(const Point& hit, double footprint, const Material* material)
+{
+    return object->surfaceColor(toObject.point(hit), footprint * footprintScale, material);
+}
+
+bool Instance::hasWithin(Point p)
+{
+    return object->hasWithin(toObject.point(p));
+}
+
+AABB Instance::bounds()
+{
+    return toWorld.box(object->bounds());
+}
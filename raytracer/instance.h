@@ -0,0 +1,61 @@
+//
+//  Framework for a raytracer
+//  File: instance.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef INSTANCE_H_FABIOUX_LEOBAL
+#define INSTANCE_H_FABIOUX_LEOBAL
+
+#include "object.h"
+#include "transform.h"
+
+// An object placed in the scene through an affine transform. The object is
+// not copied: all the instances of a mesh share its faces and its BVH, and
+// only hold their transform, so that the BVH of the scene is the top level
+// of a two-level hierarchy over the instances, and the BVH of each mesh a
+// bottom level. Rays are brought into the coordinates of the object rather
+// than the object into those of the scene.
+//
+// The object itself is not part of the scene; the material used is the
+// instance's.
+class Instance : public Object
+{
+public:
+    // toWorld must be invertible (see Transform::inverse)
+    Instance(Object* object, const Transform& toWorld);
+
+    virtual Hit intersect(const Ray &ray);
+    virtual bool occludes(const Ray &ray, double maxDistance);
+    virtual bool hasWithin(Point p);
+    virtual AABB bounds();
+    virtual Color surfaceColor(const Point& hit, double footprint, const Material* material);
+
+private:
+    Object* object;
+    Transform toWorld;
+    Transform toObject;
+    double footprintScale; // average scale of toObject, for ray footprints
+
+    // The ray in the coordinates of the object, with a unit direction for
+    // the objects that expect one. Distances along it are `scale` times the
+    // ones along ray.
+    Ray localRay(const Ray &ray, double &scale) const;
+};
+
+#endif /* end of include guard: INSTANCE_H_FABIOUX_LEOBAL */
@@ -40,22 +40,136 @@ public:
 // Forward declaration (as object.h is dependant of light.h)
 class Object;
 
+// State shared by all the rays traced for one pixel: how many secondary
+// rays it may still spawn, and its random numbers for Russian roulette
+// (seeded from the pixel, so that images do not depend on threads).
+struct PathBudget
+{
+    int raysLeft; // negative for no limit
+    unsigned int random;
+
+    PathBudget(int raysLeft, unsigned int seed) : raysLeft(raysLeft), random(seed * 2654435761u + 1) { }
+
+    // Uniform in [0, 1) (xorshift)
+    double next()
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random / 4294967296.0;
+    }
+};
+
 class Ray
 {
 public:
     Point O;
     Vector D;
     Object* origin;
-    const Ray* parent;
     double eta; // the refraction indice this ray is in
+    int originFace; // face of origin it starts from, for meshes (-1 otherwise)
+
+    // How much the colour seen along the ray counts in its pixel (product
+    // of the coefficients of the surfaces it bounced on), and the budget of
+    // its pixel (NULL if none)
+    double weight;
+    PathBudget* budget;
 
-    Ray(const Point &from, const Vector &dir, Object* origin = NULL, const Ray* parent = NULL, double eta=1)
-        : O(from), D(dir), origin(origin), parent(parent), eta(eta)
+    // Transparent objects the ray is inside of, innermost last. Deeper
+    // nesting than MAX_MEDIA is not followed (the outermost are forgotten).
+    static const int MAX_MEDIA = 4;
+    const Object* media[MAX_MEDIA];
+    int numMedia;
+
+    // The ray stands for a cone (of the size of a pixel sample for primary
+    // rays): width at O, and growth of the width per unit of distance.
+    // Used to pick the mip level of textures; 0 for a thin ray.
+    double coneWidth, coneSpread;
+
+    Ray(const Point &from, const Vector &dir, Object* origin = NULL, double eta=1)
+        : O(from), D(dir), origin(origin), eta(eta), originFace(-1),
+          weight(1), budget(NULL), numMedia(0), coneWidth(0), coneSpread(0)
     {}
 
     Point at(double t) const
     { return O + t*D; }
 
+    // Innermost object the ray is inside of (NULL in the air)
+    const Object* medium() const
+    { return numMedia > 0 ? media[numMedia-1] : NULL; }
+
+    bool isInside(const Object* object) const
+    {
+        for (int i = 0; i < numMedia; i++)
+            if (media[i] == object)
+                return true;
+        return false;
+    }
+
+    // Media of a ray continuing this one (reflected, or refracted before
+    // enter() or leave())
+    void copyMedia(const Ray& from)
+    {
+        numMedia = from.numMedia;
+        for (int i = 0; i < numMedia; i++)
+            media[i] = from.media[i];
+    }
+
+    void enter(const Object* medium)
+    {
+        if (numMedia == MAX_MEDIA)
+        {
+            for (int i = 1; i < MAX_MEDIA; i++)
+                media[i-1] = media[i];
+            numMedia--;
+        }
+        media[numMedia++] = medium;
+    }
+
+    // Objects need not be left in the order they were entered
+    void leave(const Object* medium)
+    {
+        for (int i = numMedia-1; i >= 0; i--)
+            if (media[i] == medium)
+            {
+                for (int j = i+1; j < numMedia; j++)
+                    media[j-1] = media[j];
+                numMedia--;
+                return;
+            }
+    }
+
+    // Width of the cone at distance t
+    double footprint(double t) const
+    { return coneWidth + t*coneSpread; }
+
+};
+
+// Rays traced together through the acceleration structures, for neighbouring
+// primary rays (see Scene::intersectPacket). The rays are not copied.
+class RayPacket
+{
+public:
+    static const int MAX_SIZE = 16;
+
+    const Ray* rays[MAX_SIZE];
+    int size;
+
+    RayPacket() : size(0) { }
+
+    void add(const Ray* ray) { rays[size++] = ray; }
+
+    // Whether all the directions have the same signs. Otherwise the rays
+    // diverge too much to be worth tracing together.
+    bool isCoherent() const
+    {
+        for (int i = 1; i < size; i++)
+            if ((rays[i]->D.x < 0) != (rays[0]->D.x < 0)
+                || (rays[i]->D.y < 0) != (rays[0]->D.y < 0)
+                || (rays[i]->D.z < 0) != (rays[0]->D.z < 0))
+                return false;
+        return true;
+    }
 };
 
 class Hit
@@ -64,9 +178,10 @@ public:
     double t;
     Vector N;
     bool no_hit;
+    int face; // face of a mesh that was hit (-1 for other objects)
     
     Hit(const double t, const Vector &normal, bool nohit = false)
-        : t(t), N(normal), no_hit(nohit)
+        : t(t), N(normal), no_hit(nohit), face(-1)
     { }
 
     static const Hit NO_HIT() { static Hit no_hit(std::numeric_limits<double>::quiet_NaN(),Vector(std::numeric_limits<double>::quiet_NaN(),std::numeric_limits<double>::quiet_NaN(),std::numeric_limits<double>::quiet_NaN()), true); return no_hit; }
@@ -19,26 +19,49 @@
 //
 
 #include "raytracer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 
 int main(int argc, char *argv[])
 {
     cout << "Introduction to Computer Graphics - Raytracer" << endl << endl;
-    if (argc < 2 || argc > 3) {
-        cerr << "Usage: " << argv[0] << " in-file [out-file.png]" << endl;
+
+    // Options can be given anywhere, the rest are the file names
+    std::vector<char*> files;
+    int threads = -1; // -1: as given by the scene file
+    bool stats = false;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && i+1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.size() < 1 || files.size() > 2) {
+        cerr << "Usage: " << argv[0] << " [-t threads] [--stats] in-file [out-file.png]" << endl;
         return 1;
     }
 
     Raytracer raytracer;
+    RenderStats renderStats;
+    if (stats)
+        raytracer.setStats(&renderStats);
+    if (threads >= 0)
+        raytracer.setNumThreads(threads);
 
-    if (!raytracer.readScene(argv[1])) {
-        cerr << "Error: reading scene from " << argv[1] << " failed - no output generated."<< endl;
+    if (!raytracer.readScene(files[0])) {
+        cerr << "Error: reading scene from " << files[0] << " failed - no output generated."<< endl;
         return 1;
     }
+
     std::string ofname;
-    if (argc>=3) {
-        ofname = argv[2];
+    if (files.size()>=2) {
+        ofname = files[1];
     } else {
-        ofname = argv[1];
+        ofname = files[0];
         if (ofname.size()>=5 && ofname.substr(ofname.size()-5)==".yaml") {
             ofname = ofname.substr(0,ofname.size()-5);
         }
@@ -46,5 +69,19 @@ int main(int argc, char *argv[])
     }
     raytracer.renderToFile(ofname);
 
+    // Statistics go next to the image: image.png -> image.stats.json
+    if (stats) {
+        std::string statsName = ofname;
+        if (statsName.size()>=4 && statsName.substr(statsName.size()-4)==".png") {
+            statsName = statsName.substr(0,statsName.size()-4);
+        }
+        statsName += ".stats.json";
+        if (!renderStats.writeJson(statsName)) {
+            cerr << "Error: unable to write statistics to " << statsName << "." << endl;
+            return 1;
+        }
+        cout << "Statistics written to " << statsName << "." << endl;
+    }
+
     return 0;
 }
@@ -22,7 +22,7 @@
 
 #include <iostream>
 #include "triple.h"
-#include "image.h"
+#include "texture.h"
 
 class Material
 {
@@ -31,13 +31,24 @@ public:
 	double eta;         // refractive indice
 	
     Color color;        // base color
-    Image* texture;
+    Texture* texture;   // shared with the other materials using the file
     double ka;          // ambient intensity
     double kd;          // diffuse intensity
     double ks;          // specular intensity 
     double n;           // exponent for specular highlight size
 
-    Material() { }
+    Material() : opacity(1), eta(1), texture(nullptr) { }
+
+    ~Material()
+    {
+        if (texture)
+            texture->release();
+    }
+
+private:
+    // The texture is counted once per material
+    Material(const Material&) = delete;
+    Material& operator=(const Material&) = delete;
 };
 
 #endif /* end of include guard: MATERIAL_H_TWMNT2EJ */
@@ -0,0 +1,192 @@
+//
+//  Framework for a raytracer
+//  File: mesh.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "mesh.h"
+#include "stats.h"
+
+/************************** Mesh **********************************/
+
+void Mesh::addFace(unsigned int a, unsigned int b, unsigned int c)
+{
+    i0.push_back(a);
+    i1.push_back(b);
+    i2.push_back(c);
+}
+
+void Mesh::build(BVH::Builder builder, int numThreads, bool wide)
+{
+    std::vector<AABB> boxes(getNumFaces());
+    for (unsigned int f = 0; f < getNumFaces(); f++)
+    {
+        boxes[f].extend(vertices->at(i0[f]));
+        boxes[f].extend(vertices->at(i1[f]));
+        boxes[f].extend(vertices->at(i2[f]));
+    }
+    bvh.build(boxes, builder, numThreads);
+    sahCost = bvh.sahCost();
+
+    // Store the faces in the order of the leaves, so that the faces of a
+    // leaf are next to each other in memory, and face ids follow the packs.
+    std::vector<unsigned int> s0(i0), s1(i1), s2(i2);
+    for (unsigned int i = 0; i < bvh.indices.size(); i++)
+    {
+        i0[i] = s0[bvh.indices[i]];
+        i1[i] = s1[bvh.indices[i]];
+        i2[i] = s2[bvh.indices[i]];
+    }
+
+    // Copy the faces of every leaf into packs, and make the leaf point to
+    // them instead.
+    packs.clear();
+    for (unsigned int n = 0; n < bvh.nodes.size(); n++)
+    {
+        BVH::Node& node = bvh.nodes[n];
+        if (node.count == 0)
+            continue;
+        unsigned int first = packs.size();
+        for (unsigned int f = node.start; f < node.start + node.count; f++)
+        {
+            int lane = (f - node.start) % TRIANGLE_PACK_WIDTH;
+            if (lane == 0)
+                packs.push_back(TrianglePack());
+            packs.back().set(lane, vertices->at(i0[f]), vertices->at(i1[f]), vertices->at(i2[f]), f);
+        }
+        node.start = first;
+        node.count = packs.size() - first;
+    }
+    bvh.indices.clear();
+    if (wide)
+        bvh.collapse();
+}
+
+Vector Mesh::faceNormal(unsigned int f) const
+{
+    Point p0 = vertices->at(i0[f]);
+    return (vertices->at(i1[f]) - p0).cross(vertices->at(i2[f]) - p0).normalized();
+}
+
+Hit Mesh::intersect(const Ray &ray)
+{
+    // A ray leaving the mesh can still hit its other faces, only the face it
+    // starts from is skipped.
+    int skip = ray.origin == this ? ray.originFace : -1;
+
+    PackRay packRay(ray);
+    int closest = -1;
+    double tClosest = std::numeric_limits<double>::infinity();
+    auto leaf = [&](unsigned int start, unsigned int count, double& tMax)
+    {
+        RenderStats::countTests(RenderCounters::trianglePacks, count);
+        for (unsigned int p = start; p < start + count; p++)
+        {
+            float t;
+            int lane = intersectPack(packs[p], packRay, skip, tMax, t);
+            if (lane >= 0)
+            {
+                tMax = tClosest = t;
+                closest = packs[p].face[lane];
+            }
+        }
+        return false;
+    };
+    bvh.traverseLeaves(ray, tClosest, leaf);
+
+    if (closest < 0)
+        return Hit::NO_HIT();
+
+    Hit hit(tClosest, faceNormal(closest));
+    hit.face = closest;
+    return hit;
+}
+
+unsigned int Mesh::intersectPacket(const RayPacket &packet, int first, Hit *hits)
+{
+    // Packets are made of primary rays, which don't start from a face
+    PackRay packRays[RayPacket::MAX_SIZE];
+    double tMax[RayPacket::MAX_SIZE];
+    int closest[RayPacket::MAX_SIZE];
+    for (int i = 0; i < packet.size; i++)
+    {
+        packRays[i] = PackRay(*packet.rays[i]);
+        tMax[i] = i < first ? -1.0 : hits[i].t;
+        closest[i] = -1;
+    }
+
+    auto leaf = [&](unsigned int start, unsigned int count, int first, double* tMax)
+    {
+        RenderStats::countTests(RenderCounters::trianglePacks, count * (packet.size - first));
+        for (unsigned int p = start; p < start + count; p++)
+            for (int i = first; i < packet.size; i++)
+            {
+                float t;
+                int lane = intersectPack(packs[p], packRays[i], -1, tMax[i], t);
+                if (lane >= 0)
+                {
+                    tMax[i] = t;
+                    closest[i] = packs[p].face[lane];
+                }
+            }
+    };
+    bvh.traversePacket(packet, tMax, leaf);
+
+    unsigned int closer = 0;
+    for (int i = first; i < packet.size; i++)
+    {
+        if (closest[i] < 0)
+            continue;
+        hits[i] = Hit(tMax[i], faceNormal(closest[i]));
+        hits[i].face = closest[i];
+        closer |= 1u << i;
+    }
+    return closer;
+}
+
+bool Mesh::occludes(const Ray &ray, double maxDistance)
+{
+    int skip = ray.origin == this ? ray.originFace : -1;
+
+    PackRay packRay(ray);
+    bool blocked = false;
+    auto leaf = [&](unsigned int start, unsigned int count, double&)
+    {
+        unsigned int p;
+        for (p = start; p < start + count && !blocked; p++)
+        {
+            float t;
+            blocked = intersectPack(packs[p], packRay, skip, maxDistance, t) >= 0;
+        }
+        RenderStats::countTests(RenderCounters::trianglePacks, p - start);
+        return blocked;
+    };
+    bvh.traverseLeaves(ray, maxDistance, leaf);
+    return blocked;
+}
+
+bool Mesh::hasWithin(Point p)
+{
+	//TODO/FIXME
+	return false;
+}
+
+AABB Mesh::bounds()
+{
+    return bvh.bounds();
+}
@@ -0,0 +1,93 @@
+//
+//  Framework for a raytracer
+//  File: mesh.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef MESH_H_FABIOUX_LEOBAL
+#define MESH_H_FABIOUX_LEOBAL
+
+#include <vector>
+#include "object.h"
+#include "bvh.h"
+#include "trianglepack.h"
+
+// Vertex positions of a model, stored as one array per coordinate.
+// Shared by all the meshes (material groups) of the model.
+class MeshVertices
+{
+public:
+    std::vector<float> x, y, z;
+
+    unsigned int size() const { return x.size(); }
+
+    void add(float vx, float vy, float vz)
+    {
+        x.push_back(vx);
+        y.push_back(vy);
+        z.push_back(vz);
+    }
+
+    Point at(unsigned int i) const { return Point(x[i], y[i], z[i]); }
+};
+
+// Indexed triangle mesh: faces are three indices into shared vertices, and
+// the mesh intersects its own faces through its own BVH. Faces are culled
+// like Triangle (only the counter-clockwise side is visible).
+// The faces of each leaf are also copied into TrianglePacks, so that a leaf
+// is tested with a few SIMD operations.
+class Mesh : public Object
+{
+public:
+    Mesh(const MeshVertices* vertices) : vertices(vertices), sahCost(0) { }
+
+    void addFace(unsigned int a, unsigned int b, unsigned int c);
+
+    // Builds the BVH over the faces, on up to numThreads threads, and
+    // collapses it into wide nodes if asked. Must be called once all the
+    // faces have been added, and before intersecting.
+    void build(BVH::Builder builder = BVH::sah, int numThreads = 1, bool wide = true);
+
+    virtual Hit intersect(const Ray &ray);
+    virtual unsigned int intersectPacket(const RayPacket &packet, int first, Hit *hits);
+    virtual bool occludes(const Ray &ray, double maxDistance);
+    virtual bool hasWithin(Point p);
+    virtual AABB bounds();
+
+    unsigned int getNumFaces() const { return i0.size(); }
+
+    // SAH cost of the BVH over the faces (see BVH::sahCost)
+    double getSahCost() const { return sahCost; }
+
+private:
+    friend class MeshCache;
+
+    const MeshVertices* vertices;
+
+    // Vertex indices of each face, one array per corner
+    std::vector<unsigned int> i0, i1, i2;
+
+    // Once built, the leaves of the BVH refer to ranges of packs, not faces
+    BVH bvh;
+    std::vector<TrianglePack> packs;
+    double sahCost; // measured on faces, before they are packed
+
+    Vector faceNormal(unsigned int f) const;
+};
+
+#endif /* end of include guard: MESH_H_FABIOUX_LEOBAL */
@@ -0,0 +1,575 @@
+//
+//  Framework for a raytracer
+//  File: meshcache.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+
+#include "meshcache.h"
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MESHCACHE_VERSION 6
+
+namespace {
+
+const char MAGIC[8] = { 'R', 'T', 'M', 'E', 'S', 'H', '\r', '\n' };
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t packWidth;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t payloadHash; // of everything after the header
+    double size;
+    double position[3];
+    float bounds[6];
+    double buildSeconds;
+    uint32_t builder;
+    uint32_t wide;
+    uint32_t numLibraries;
+    uint32_t numMaterials;
+    uint32_t numVertices;
+    uint32_t numMeshes;
+};
+
+struct MeshHeader
+{
+    uint32_t material;
+    uint32_t numFaces;
+    uint32_t numNodes; // 0 if the hierarchy is not stored
+    uint32_t numPacks;
+    uint32_t wide;     // whether the nodes are WideNodes
+    double sahCost;
+    double bounds[6];  // of the hierarchy, which wide nodes do not store
+};
+
+// Hierarchy node as stored: AABB holds doubles, with padding around
+struct NodeRecord
+{
+    double min[3];
+    double max[3];
+    uint32_t start;
+    uint32_t count;
+};
+
+bool littleEndian()
+{
+    uint32_t one = 1;
+    return *(const char*)&one == 1;
+}
+
+uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Four independent multiply-xor lanes over 8-byte words, so that hashing
+// goes at about the speed of reading the memory
+uint64_t hashBytes(const char* data, size_t size)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    uint64_t lanes[4] = { 1, 2, 3, 4 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+        for (int l = 0; l < 4; l++)
+        {
+            uint64_t word;
+            memcpy(&word, data + i + 8*l, 8);
+            lanes[l] = (lanes[l] ^ word) * k;
+            lanes[l] ^= lanes[l] >> 29;
+        }
+    uint64_t h = size;
+    for (int l = 0; l < 4; l++)
+        h = mix(h ^ lanes[l]) * k;
+    for (; i < size; i++)
+        h = (h ^ (unsigned char)data[i]) * k;
+    return mix(h);
+}
+
+// Appends to a buffer, keeping track of alignment
+class Writer
+{
+public:
+    std::vector<char> data;
+
+    void write(const void* p, size_t size)
+    {
+        data.insert(data.end(), (const char*)p, (const char*)p + size);
+    }
+
+    template <class T>
+    void write(const T& value) { write(&value, sizeof(T)); }
+
+    void writeString(const std::string& s)
+    {
+        write((uint32_t)s.size());
+        write(s.data(), s.size());
+    }
+
+    void align(size_t alignment)
+    {
+        data.resize((data.size() + alignment - 1) / alignment * alignment, 0);
+    }
+};
+
+// Reads from a mapped file, failing on anything out of bounds
+class Reader
+{
+public:
+    Reader(const char* begin, const char* end) : p(begin), begin(begin), end(end), ok(true) { }
+
+    const char* take(size_t size)
+    {
+        if (!ok || (size_t)(end - p) < size)
+        {
+            ok = false;
+            return 0;
+        }
+        const char* at = p;
+        p += size;
+        return at;
+    }
+
+    template <class T>
+    bool read(T& value)
+    {
+        const char* at = take(sizeof(T));
+        if (at)
+            memcpy(&value, at, sizeof(T));
+        return at != 0;
+    }
+
+    bool readString(std::string& s)
+    {
+        uint32_t length;
+        if (!read(length))
+            return false;
+        const char* at = take(length);
+        if (at)
+            s.assign(at, length);
+        return at != 0;
+    }
+
+    // Arrays are aligned for their type in the file, and the file is
+    // mapped at a page boundary: they are copied straight from the mapping
+    // into the vectors of the meshes, in one pass
+    template <class T>
+    bool readArray(std::vector<T>& values, size_t count)
+    {
+        const T* at = (const T*)take(count * sizeof(T));
+        if (!at)
+            return false;
+        values.assign(at, at + count);
+        return true;
+    }
+
+    void align(size_t alignment)
+    {
+        size_t offset = p - begin;
+        take((offset + alignment - 1) / alignment * alignment - offset);
+    }
+
+    bool isOk() const { return ok; }
+
+private:
+    const char* p;
+    const char* begin;
+    const char* end;
+    bool ok;
+};
+
+// A whole file mapped in memory
+class MappedFile
+{
+public:
+    const char* data;
+    size_t size;
+
+    MappedFile(const std::string& fileName) : data(0), size(0)
+    {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* mapped = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                data = (const char*)mapped;
+                size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+            munmap((void*)data, size);
+    }
+};
+
+// Size and modification time (in nanoseconds) of a file. Returns false if
+// there is no such file.
+bool fileStamp(const std::string& fileName, uint64_t& size, int64_t& time)
+{
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0)
+        return false;
+    size = info.st_size;
+    time = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+// Whether a file is still the one a cache was made from: it is not read if
+// its size and modification time did not change, else its contents are
+// hashed (the time changes when a file is copied or touched)
+bool sameSource(const std::string& fileName, uint64_t size, int64_t time, uint64_t hash)
+{
+    uint64_t currentSize;
+    int64_t currentTime;
+    if (!fileStamp(fileName, currentSize, currentTime) || currentSize != size)
+        return false;
+    return currentTime == time || MeshCache::hashFile(fileName, currentSize) == hash;
+}
+
+// Stamp and hash of a source file, as stored in the cache
+void writeSource(Writer& out, const std::string& fileName)
+{
+    uint64_t size = 0, hashedSize;
+    int64_t time = 0;
+    fileStamp(fileName, size, time);
+    out.write(size);
+    out.write(time);
+    out.write(MeshCache::hashFile(fileName, hashedSize));
+}
+
+void writeMaterial(Writer& out, const ObjMaterial& m)
+{
+    out.writeString(m.name);
+    out.write(m.ambient, sizeof(m.ambient));
+    out.write(m.diffuse, sizeof(m.diffuse));
+    out.write(m.specular, sizeof(m.specular));
+    out.write(m.emissive, sizeof(m.emissive));
+    out.write(m.shininess);
+}
+
+bool readMaterial(Reader& in, ObjMaterial& m)
+{
+    const char* at;
+    if (!in.readString(m.name) || !(at = in.take(13 * sizeof(float))))
+        return false;
+    memcpy(m.ambient, at, sizeof(m.ambient));
+    memcpy(m.diffuse, at + 3 * sizeof(float), sizeof(m.diffuse));
+    memcpy(m.specular, at + 6 * sizeof(float), sizeof(m.specular));
+    memcpy(m.emissive, at + 9 * sizeof(float), sizeof(m.emissive));
+    memcpy(&m.shininess, at + 12 * sizeof(float), sizeof(float));
+    return true;
+}
+
+}
+
+uint64_t MeshCache::hashFile(const std::string& fileName, uint64_t& fileSize)
+{
+    MappedFile file(fileName);
+    fileSize = file.size;
+    return file.data ? hashBytes(file.data, file.size) : 0;
+}
+
+std::string MeshCache::path(const std::string& fileName, double size, const Point& position,
+    BVH::Builder builder, bool wide)
+{
+    double transform[6] = { size, position.x, position.y, position.z, (double)builder, (double)wide };
+    std::ostringstream name;
+    name << fileName << "." << std::hex << std::setw(8) << std::setfill('0')
+        << (uint32_t)hashBytes((const char*)transform, sizeof(transform)) << ".meshcache";
+    return name.str();
+}
+
+bool MeshCache::load(const std::string& fileName, double size, const Point& position, Model& model)
+{
+    if (!littleEndian())
+        return false;
+    MappedFile file(path(fileName, size, position, model.builder, model.wide));
+    if (!file.data)
+        return false;
+
+    Reader in(file.data, file.data + file.size);
+    Header header;
+    if (!in.read(header)
+        || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || header.version != MESHCACHE_VERSION
+        || header.packWidth != TRIANGLE_PACK_WIDTH
+        || header.builder != (uint32_t)model.builder
+        || header.wide != (uint32_t)model.wide
+        || header.size != size
+        || header.position[0] != position.x
+        || header.position[1] != position.y
+        || header.position[2] != position.z)
+        return false;
+
+    if (!sameSource(fileName, header.sourceSize, header.sourceTime, header.sourceHash))
+        return false;
+
+    // A damaged file is rebuilt rather than trusted: besides the checksum,
+    // every index read is checked against the arrays it points into
+    if (hashBytes(file.data + sizeof(Header), file.size - sizeof(Header)) != header.payloadHash)
+        return false;
+
+    // Nothing is given to model before the whole file is read
+    std::vector<std::string> libraries(header.numLibraries);
+    for (unsigned int i = 0; i < header.numLibraries; i++)
+    {
+        uint64_t librarySize, hash;
+        int64_t time;
+        if (!in.readString(libraries[i]) || !in.read(librarySize) || !in.read(time) || !in.read(hash)
+            || !sameSource(libraries[i], librarySize, time, hash))
+            return false;
+    }
+
+    std::vector<ObjMaterial> materials(header.numMaterials);
+    for (unsigned int i = 0; i < header.numMaterials; i++)
+        if (!readMaterial(in, materials[i]))
+            return false;
+
+    MeshVertices* vertices = new MeshVertices();
+    in.align(8);
+    in.readArray(vertices->x, header.numVertices);
+    in.readArray(vertices->y, header.numVertices);
+    in.readArray(vertices->z, header.numVertices);
+
+    std::vector<Mesh*> meshes;
+    std::vector<unsigned int> meshMaterials;
+    // Whether the faces of a mesh use only the vertices read, and its packs
+    // only its faces
+    auto validFaces = [&](const Mesh* mesh) {
+        for (unsigned int f = 0; f < mesh->getNumFaces(); f++)
+            if (mesh->i0[f] >= header.numVertices || mesh->i1[f] >= header.numVertices
+                || mesh->i2[f] >= header.numVertices)
+                return false;
+        for (unsigned int p = 0; p < mesh->packs.size(); p++)
+            for (int lane = 0; lane < TRIANGLE_PACK_WIDTH; lane++)
+            {
+                int face = mesh->packs[p].face[lane];
+                if (face < -1 || face >= (int)mesh->getNumFaces())
+                    return false;
+            }
+        return true;
+    };
+    bool valid = true;
+    for (unsigned int m = 0; m < header.numMeshes && in.isOk() && valid; m++)
+    {
+        MeshHeader meshHeader;
+        in.align(8);
+        if (!in.read(meshHeader) || meshHeader.material >= header.numMaterials)
+            break;
+
+        Mesh* mesh = new Mesh(vertices);
+        meshes.push_back(mesh);
+        meshMaterials.push_back(meshHeader.material);
+        in.readArray(mesh->i0, meshHeader.numFaces);
+        in.readArray(mesh->i1, meshHeader.numFaces);
+        in.readArray(mesh->i2, meshHeader.numFaces);
+
+        valid = in.isOk() && validFaces(mesh);
+        if (!valid)
+            break;
+
+        if (meshHeader.numNodes == 0)
+        {
+            // Only the faces were stored: build the hierarchy now
+            mesh->build(model.builder, 1, model.wide);
+            continue;
+        }
+        mesh->sahCost = meshHeader.sahCost;
+        if (meshHeader.wide)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                mesh->bvh.wideBounds.min.data[k] = meshHeader.bounds[k];
+                mesh->bvh.wideBounds.max.data[k] = meshHeader.bounds[k+3];
+            }
+            in.align(64);
+            in.readArray(mesh->bvh.wideNodes, meshHeader.numNodes);
+            in.align(32);
+            in.readArray(mesh->packs, meshHeader.numPacks);
+            valid = in.isOk() && validFaces(mesh) && mesh->bvh.isValid(mesh->packs.size());
+            continue;
+        }
+        const NodeRecord* records = (const NodeRecord*)in.take(meshHeader.numNodes * sizeof(NodeRecord));
+        if (!records)
+            break;
+        mesh->bvh.nodes.reserve(meshHeader.numNodes);
+        for (unsigned int n = 0; n < meshHeader.numNodes; n++)
+        {
+            BVH::Node node;
+            node.box.min = Point(records[n].min[0], records[n].min[1], records[n].min[2]);
+            node.box.max = Point(records[n].max[0], records[n].max[1], records[n].max[2]);
+            node.start = records[n].start;
+            node.count = records[n].count;
+            mesh->bvh.nodes.push_back(node);
+        }
+        in.align(32);
+        in.readArray(mesh->packs, meshHeader.numPacks);
+        valid = in.isOk() && validFaces(mesh) && mesh->bvh.isValid(mesh->packs.size());
+    }
+
+    if (!valid || !in.isOk() || meshes.size() != header.numMeshes)
+    {
+        for (unsigned int m = 0; m < meshes.size(); m++)
+            delete meshes[m];
+        delete vertices;
+        return false;
+    }
+    model.libraries = libraries;
+    model.materials = materials;
+    model.vertices = vertices;
+    model.meshes = meshes;
+    model.meshMaterials = meshMaterials;
+    model.buildSeconds = header.buildSeconds;
+    return true;
+}
+
+bool MeshCache::save(const std::string& fileName, double size, const Point& position, const Model& model)
+{
+    if (!littleEndian())
+        return false;
+
+    Writer out;
+    Header header;
+    memset(&header, 0, sizeof(header)); // no garbage in the padding
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = MESHCACHE_VERSION;
+    header.packWidth = TRIANGLE_PACK_WIDTH;
+    header.sourceHash = hashFile(fileName, header.sourceSize);
+    fileStamp(fileName, header.sourceSize, header.sourceTime);
+    header.size = size;
+    header.position[0] = position.x;
+    header.position[1] = position.y;
+    header.position[2] = position.z;
+    AABB bounds;
+    for (unsigned int m = 0; m < model.meshes.size(); m++)
+        bounds.extend(model.meshes[m]->bounds());
+    for (int k = 0; k < 3; k++)
+    {
+        header.bounds[k] = bounds.isEmpty() ? 0.0f : (float)bounds.min.data[k];
+        header.bounds[k+3] = bounds.isEmpty() ? 0.0f : (float)bounds.max.data[k];
+    }
+    header.buildSeconds = model.buildSeconds;
+    header.builder = model.builder;
+    header.wide = model.wide;
+    header.numLibraries = model.libraries.size();
+    header.numMaterials = model.materials.size();
+    header.numVertices = model.vertices->size();
+    header.numMeshes = model.meshes.size();
+    out.write(header);
+
+    for (unsigned int i = 0; i < model.libraries.size(); i++)
+    {
+        out.writeString(model.libraries[i]);
+        writeSource(out, model.libraries[i]);
+    }
+    for (unsigned int i = 0; i < model.materials.size(); i++)
+        writeMaterial(out, model.materials[i]);
+
+    const MeshVertices* vertices = model.vertices;
+    out.align(8);
+    out.write(vertices->x.data(), vertices->size() * sizeof(float));
+    out.write(vertices->y.data(), vertices->size() * sizeof(float));
+    out.write(vertices->z.data(), vertices->size() * sizeof(float));
+
+    for (unsigned int m = 0; m < model.meshes.size(); m++)
+    {
+        const Mesh* mesh = model.meshes[m];
+        MeshHeader meshHeader;
+        memset(&meshHeader, 0, sizeof(meshHeader));
+        meshHeader.material = model.meshMaterials[m];
+        meshHeader.numFaces = mesh->getNumFaces();
+        meshHeader.numPacks = mesh->packs.size();
+        meshHeader.wide = !mesh->bvh.wideNodes.empty();
+        meshHeader.numNodes = meshHeader.wide ? mesh->bvh.wideNodes.size() : mesh->bvh.nodes.size();
+        meshHeader.sahCost = mesh->sahCost;
+        AABB bounds = mesh->bvh.bounds();
+        for (int k = 0; k < 3; k++)
+        {
+            meshHeader.bounds[k] = bounds.min.data[k];
+            meshHeader.bounds[k+3] = bounds.max.data[k];
+        }
+        out.align(8);
+        out.write(meshHeader);
+        out.write(mesh->i0.data(), mesh->i0.size() * sizeof(unsigned int));
+        out.write(mesh->i1.data(), mesh->i1.size() * sizeof(unsigned int));
+        out.write(mesh->i2.data(), mesh->i2.size() * sizeof(unsigned int));
+        if (meshHeader.wide)
+        {
+            out.align(64);
+            out.write(mesh->bvh.wideNodes.data(), mesh->bvh.wideNodes.size() * sizeof(WideNode));
+        }
+        for (unsigned int n = 0; n < mesh->bvh.nodes.size(); n++)
+        {
+            const BVH::Node& node = mesh->bvh.nodes[n];
+            NodeRecord record;
+            for (int k = 0; k < 3; k++)
+            {
+                record.min[k] = node.box.min.data[k];
+                record.max[k] = node.box.max.data[k];
+            }
+            record.start = node.start;
+            record.count = node.count;
+            out.write(record);
+        }
+        out.align(32);
+        out.write(mesh->packs.data(), mesh->packs.size() * sizeof(TrianglePack));
+    }
+
+    uint64_t payloadHash = hashBytes(out.data.data() + sizeof(Header), out.data.size() - sizeof(Header));
+    memcpy(out.data.data() + offsetof(Header, payloadHash), &payloadHash, sizeof(payloadHash));
+
+    // Written under another name then renamed, so that a render started
+    // meanwhile never reads half a file
+    std::string name = path(fileName, size, position, model.builder, model.wide);
+    std::string temporary = name + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    bool ok = file && fwrite(out.data.data(), 1, out.data.size(), file) == out.data.size();
+    if (file)
+        ok = fclose(file) == 0 && ok;
+    if (ok)
+        ok = rename(temporary.c_str(), name.c_str()) == 0;
+    if (!ok)
+    {
+        remove(temporary.c_str());
+        std::cerr << "Warning: can't write mesh cache \"" << name << "\"." << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,93 @@
+//
+//  Framework for a raytracer
+//  File: meshcache.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+
+#ifndef MESHCACHE_H_FABIOUX_LEOBAL
+#define MESHCACHE_H_FABIOUX_LEOBAL
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "objloader.h"
+
+// Binary copy of a loaded model, written next to its OBJ file the first time
+// it is loaded, so that the next renders skip parsing the file and building
+// the hierarchies of the meshes. The cache file is named after the model,
+// its transform (size and position) and the builder and width of its
+// hierarchies (so that every build of a model is kept). It remembers the
+// size, modification time and hash of the OBJ file and of its material
+// libraries: a file whose size and time did not change is not read again,
+// else it is hashed, and if its contents changed the cache is ignored and
+// written again.
+//
+// The format is little-endian (processors of other endianness just do not
+// use caches):
+//     header      magic, version, pack width, hash, size and time of the OBJ
+//                 file, hash of the rest of the cache file, transform,
+//                 bounds, time it took to read and build, the hierarchy
+//                 builder and width, and the number of each item below
+//     libraries   path, size, time and hash of each material library
+//     materials   name and colours of each material
+//     vertices    the x, the y, then the z coordinates, in float
+//     meshes      material, SAH cost and bounds, faces (the three corner
+//                 arrays), then optionally the hierarchy nodes (binary or
+//                 wide) and triangle packs built from them
+// Arrays start at multiples of 8 bytes, packs at multiples of 32 and wide
+// nodes of 64, as they are in memory: the file is mapped, and every array is
+// copied out of it at once, without converting its items.
+class MeshCache
+{
+public:
+    // A model once loaded, transformed, and cut into meshes
+    struct Model
+    {
+        MeshVertices* vertices;
+        std::vector<ObjMaterial> materials;
+        std::vector<Mesh*> meshes;
+        std::vector<unsigned int> meshMaterials; // index in materials
+        std::vector<std::string> libraries; // material libraries read
+        double buildSeconds; // time it took to read the file and build the meshes
+        BVH::Builder builder; // how the hierarchies of the meshes are built
+        bool wide;            // and whether they are collapsed into wide nodes
+
+        Model() : vertices(0), buildSeconds(0), builder(BVH::sah), wide(true) { }
+    };
+
+    // Loads the cached copy of the model file with this transform, built
+    // with model.builder and model.wide. Returns false, leaving model as it
+    // was, if there is none, if it is out of date, or if it is damaged (its
+    // checksum or one of its indices is wrong).
+    static bool load(const std::string& fileName, double size, const Point& position, Model& model);
+
+    // Writes the cache file of the model. Returns false (with a warning) if
+    // the file cannot be written.
+    static bool save(const std::string& fileName, double size, const Point& position, const Model& model);
+
+    // Name of the cache file of a model with this transform and hierarchies
+    static std::string path(const std::string& fileName, double size, const Point& position,
+        BVH::Builder builder, bool wide);
+
+    // Hash of the contents of a file (0 if it cannot be read)
+    static uint64_t hashFile(const std::string& fileName, uint64_t& fileSize);
+};
+
+#endif /* end of include guard: MESHCACHE_H_FABIOUX_LEOBAL */
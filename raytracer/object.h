@@ -24,6 +24,7 @@
 
 #include "triple.h"
 #include "light.h"
+#include "aabb.h"
 
 #include "material.h"
 
@@ -36,8 +37,46 @@ public:
     virtual Hit intersect(const Ray &ray) = 0;
     
     virtual bool hasWithin(Point p) = 0;
+
+    // Box enclosing the object, used to build acceleration structures
+    virtual AABB bounds() = 0;
+
+    // Intersects the rays of the packet from `first` on, and replaces hits[i]
+    // when ray i hits the object closer. Returns the rays whose hit was
+    // replaced, as a bit mask.
+    virtual unsigned int intersectPacket(const RayPacket &packet, int first, Hit *hits)
+    {
+        unsigned int closer = 0;
+        for (int i = first; i < packet.size; i++)
+        {
+            Hit hit(intersect(*packet.rays[i]));
+            if (hit.t < hits[i].t)
+            {
+                hits[i] = hit;
+                closer |= 1u << i;
+            }
+        }
+        return closer;
+    }
+
+    // Whether the object blocks the ray before maxDistance. Objects made of
+    // many faces can stop at the first one found instead of the closest.
+    virtual bool occludes(const Ray &ray, double maxDistance)
+    {
+        double t = intersect(ray).t;
+        return t > 0 && t < maxDistance;
+    }
     
-    virtual Color colorAt(const Point& hit) { return material->color;};
+    // Colour of the surface at hit, for a ray whose footprint there is that
+    // wide (see Ray::footprint), to filter textures
+    Color colorAt(const Point& hit, double footprint) { return surfaceColor(hit, footprint, material); }
+
+    // The same with the given material: an instance gives its own to the
+    // object it places in the scene
+    virtual Color surfaceColor(const Point& hit, double footprint, const Material* material)
+    {
+        return material->color;
+    }
 };
 
 #endif /* end of include guard: OBJECT_H_AXKLE0OF */
@@ -0,0 +1,498 @@
+//
+//  Framework for a raytracer
+//  File: objloader.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+
+#include "objloader.h"
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scheduler.h"
+
+// Chunks are at least that big, so that small files are read at once
+#define OBJ_MIN_CHUNK (1 << 20)
+
+ObjMaterial::ObjMaterial(const std::string& name) : name(name), shininess(65.0f)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        ambient[i] = 0.2f;
+        diffuse[i] = 0.8f;
+        specular[i] = 0.0f;
+        emissive[i] = 0.0f;
+    }
+}
+
+namespace {
+
+// Hand-written scanners. Each one starts at p, never reads at or past end,
+// and returns where it stopped.
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline const char* skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+inline const char* skipLine(const char* p, const char* end)
+{
+    while (p < end && *p != '\n')
+        p++;
+    return p < end ? p + 1 : end;
+}
+
+// Reads a number such as -1.25e-3. Sets ok to false if there is none.
+const char* parseFloat(const char* p, const char* end, float& value, bool& ok)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // Up to 19 significant digits are kept in an integer, and the position
+    // of the decimal point in an exponent of ten
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); p++, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > 0)
+                digits++;
+        }
+        else
+            exponent++;
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && isDigit(*p); p++, any = true)
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa > 0)
+                    digits++;
+                exponent--;
+            }
+    }
+    if (!any)
+    {
+        ok = false;
+        return p;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && isDigit(*q))
+        {
+            int e = 0;
+            for (; q < end && isDigit(*q); q++)
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (exponent >= 0 && exponent <= 22)
+        result *= powers[exponent];
+    else if (exponent < 0 && exponent >= -22)
+        result /= powers[-exponent];
+    else
+        result *= pow(10.0, exponent);
+    value = (float)(negative ? -result : result);
+    ok = true;
+    return p;
+}
+
+// Reads an integer. Sets ok to false if there is none.
+inline const char* parseInt(const char* p, const char* end, long& value, bool& ok)
+{
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    ok = p < end && isDigit(*p);
+    long result = 0;
+    for (; p < end && isDigit(*p); p++)
+        result = result * 10 + (*p - '0');
+    value = negative ? -result : result;
+    return p;
+}
+
+// Reads the rest of the line, without the blanks around it
+const char* parseName(const char* p, const char* end, std::string& name)
+{
+    p = skipBlanks(p, end);
+    const char* last = p;
+    const char* q = p;
+    for (; q < end && *q != '\n'; q++)
+        if (!isBlank(*q))
+            last = q + 1;
+    name.assign(p, last);
+    return q;
+}
+
+// Whether the line at p starts with the given keyword, followed by a blank
+inline bool keyword(const char* p, const char* end, const char* word, int length)
+{
+    return end - p > length && isBlank(p[length]) && std::equal(word, word + length, p);
+}
+
+// What a chunk of the file contains. Indices can only be resolved once the
+// number of vertices of the previous chunks is known: corners holds them
+// 0-based, except the relative (negative) ones, listed in relative and
+// stored relative to the first vertex of the chunk.
+struct Chunk
+{
+    const char* begin;
+    const char* end;
+    std::vector<float> x, y, z;
+    std::vector<long> corners;
+    std::vector<unsigned int> relative;
+    std::vector<std::pair<unsigned int, std::string> > materials; // (first triangle, name)
+    std::vector<std::string> libraries;
+    unsigned int badFaces;
+};
+
+void parseChunk(Chunk& chunk)
+{
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    std::vector<long> polygon;
+    std::vector<char> polygonRelative;
+    chunk.badFaces = 0;
+
+    while (p < end)
+    {
+        p = skipBlanks(p, end);
+        if (p == end)
+            break;
+
+        if (keyword(p, end, "v", 1))
+        {
+            float v[3] = { 0.0f, 0.0f, 0.0f };
+            bool ok = true;
+            p++;
+            for (int i = 0; i < 3 && ok; i++)
+                p = parseFloat(p, end, v[i], ok);
+            chunk.x.push_back(v[0]);
+            chunk.y.push_back(v[1]);
+            chunk.z.push_back(v[2]);
+        }
+        else if (keyword(p, end, "f", 1))
+        {
+            // Vertex index of each corner: "v", "v/t", "v//n" or "v/t/n"
+            polygon.clear();
+            polygonRelative.clear();
+            bool valid = true;
+            p++;
+            while (true)
+            {
+                p = skipBlanks(p, end);
+                if (p == end || *p == '\n' || *p == '#')
+                    break;
+                long index;
+                bool ok;
+                p = parseInt(p, end, index, ok);
+                if (!ok || index == 0)
+                    valid = false;
+                else if (index > 0)
+                {
+                    polygon.push_back(index - 1);
+                    polygonRelative.push_back(0);
+                }
+                else
+                {
+                    polygon.push_back((long)chunk.x.size() + index);
+                    polygonRelative.push_back(1);
+                }
+                while (p < end && !isBlank(*p) && *p != '\n')
+                    p++;
+            }
+
+            if (!valid || polygon.size() < 3)
+                chunk.badFaces++;
+            else
+            {
+                // Fan around the first corner, as glm does
+                for (unsigned int i = 2; i < polygon.size(); i++)
+                {
+                    unsigned int corners[3] = { 0, i - 1, i };
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (polygonRelative[corners[k]])
+                            chunk.relative.push_back(chunk.corners.size());
+                        chunk.corners.push_back(polygon[corners[k]]);
+                    }
+                }
+            }
+        }
+        else if (keyword(p, end, "usemtl", 6))
+        {
+            std::string name;
+            p = parseName(p + 6, end, name);
+            chunk.materials.push_back(std::make_pair((unsigned int)(chunk.corners.size() / 3), name));
+        }
+        else if (keyword(p, end, "mtllib", 6))
+        {
+            // Several libraries can be given on the same line
+            p += 6;
+            while (true)
+            {
+                p = skipBlanks(p, end);
+                if (p == end || *p == '\n')
+                    break;
+                const char* q = p;
+                while (q < end && !isBlank(*q) && *q != '\n')
+                    q++;
+                chunk.libraries.push_back(std::string(p, q));
+                p = q;
+            }
+        }
+        // Anything else (comments, normals, texture coordinates, groups,
+        // smoothing) is skipped
+
+        p = skipLine(p, end);
+    }
+}
+
+std::string directory(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+}
+
+unsigned int ObjModel::findMaterial(const std::string& name)
+{
+    for (unsigned int i = 0; i < materials.size(); i++)
+        if (materials[i].name == name)
+            return i;
+    std::cerr << "Warning: can't find material \"" << name << "\", using the default material." << std::endl;
+    return 0;
+}
+
+void ObjModel::readMaterials(const std::string& filename)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Warning: can't open material file \"" << filename << "\"." << std::endl;
+        return;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const char* p = text.data();
+    const char* end = p + text.size();
+
+    ObjMaterial* material = 0;
+    while (p < end)
+    {
+        p = skipBlanks(p, end);
+        float* color = 0;
+        if (keyword(p, end, "newmtl", 6))
+        {
+            std::string name;
+            p = parseName(p + 6, end, name);
+            materials.push_back(ObjMaterial(name));
+            material = &materials.back();
+        }
+        else if (material && keyword(p, end, "Ns", 2))
+        {
+            bool ok;
+            float shininess;
+            p = parseFloat(p + 2, end, shininess, ok);
+            if (ok)
+                material->shininess = shininess / 1000.0f * 128.0f;
+        }
+        else if (material && keyword(p, end, "Ka", 2))
+            color = material->ambient;
+        else if (material && keyword(p, end, "Kd", 2))
+            color = material->diffuse;
+        else if (material && keyword(p, end, "Ks", 2))
+            color = material->specular;
+        else if (material && keyword(p, end, "Ke", 2))
+            color = material->emissive;
+
+        if (color)
+        {
+            bool ok = true;
+            p += 2;
+            for (int i = 0; i < 3 && ok; i++)
+                p = parseFloat(p, end, color[i], ok);
+        }
+        p = skipLine(p, end);
+    }
+}
+
+bool ObjModel::read(const std::string& filename, MeshVertices* vertices, int numThreads)
+{
+    materials.clear();
+    materials.push_back(ObjMaterial());
+    faces.clear();
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Error: can't open model file \"" << filename << "\"." << std::endl;
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    size_t size = info.st_size;
+    const char* data = 0;
+    std::vector<char> buffer;
+    if (size > 0)
+    {
+        void* mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+            data = (const char*)mapped;
+        else
+        {
+            // Not mappable (some special files): read it instead
+            buffer.resize(size);
+            size_t done = 0;
+            ssize_t n;
+            while (done < size && (n = ::read(fd, &buffer[done], size - done)) > 0)
+                done += n;
+            buffer.resize(done);
+            size = done;
+            data = buffer.empty() ? 0 : &buffer[0];
+        }
+    }
+    close(fd);
+
+    // Cut into chunks of whole lines
+    if (numThreads < 1)
+        numThreads = 1;
+    size_t chunkSize = std::max((size_t)OBJ_MIN_CHUNK, size / (numThreads * 4) + 1);
+    std::vector<Chunk> chunks;
+    const char* end = data + size;
+    for (const char* p = data; p < end; )
+    {
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end = end - p > (ptrdiff_t)chunkSize ? skipLine(p + chunkSize, end) : end;
+        chunks.push_back(chunk);
+        p = chunk.end;
+    }
+
+    TileScheduler::parallelFor(numThreads, chunks.size(), [&](int i, int)
+    {
+        parseChunk(chunks[i]);
+    });
+
+    if (data && buffer.empty())
+        munmap((void*)data, size);
+
+    // Material libraries first, so that materials can be found by name
+    std::string dir = directory(filename);
+    for (unsigned int c = 0; c < chunks.size(); c++)
+        for (unsigned int l = 0; l < chunks[c].libraries.size(); l++)
+        {
+            libraries.push_back(dir + chunks[c].libraries[l]);
+            readMaterials(libraries.back());
+        }
+    faces.resize(materials.size());
+
+    // Vertices of all chunks, each chunk copied in place
+    unsigned int first = vertices->size();
+    std::vector<unsigned int> base(chunks.size() + 1, first);
+    for (unsigned int c = 0; c < chunks.size(); c++)
+        base[c+1] = base[c] + chunks[c].x.size();
+    vertices->x.resize(base.back());
+    vertices->y.resize(base.back());
+    vertices->z.resize(base.back());
+    TileScheduler::parallelFor(numThreads, chunks.size(), [&](int c, int)
+    {
+        std::copy(chunks[c].x.begin(), chunks[c].x.end(), vertices->x.begin() + base[c]);
+        std::copy(chunks[c].y.begin(), chunks[c].y.end(), vertices->y.begin() + base[c]);
+        std::copy(chunks[c].z.begin(), chunks[c].z.end(), vertices->z.begin() + base[c]);
+    });
+
+    // Triangles, sorted by material. The material of the end of a chunk
+    // carries over to the next one.
+    unsigned int material = 0, badFaces = 0, badIndices = 0;
+    for (unsigned int c = 0; c < chunks.size(); c++)
+    {
+        Chunk& chunk = chunks[c];
+        badFaces += chunk.badFaces;
+        for (unsigned int i = 0; i < chunk.relative.size(); i++)
+            chunk.corners[chunk.relative[i]] += base[c] - first;
+
+        std::vector<std::pair<unsigned int, unsigned int> > switches; // (first triangle, material)
+        for (unsigned int i = 0; i < chunk.materials.size(); i++)
+            switches.push_back(std::make_pair(chunk.materials[i].first, findMaterial(chunk.materials[i].second)));
+
+        unsigned int next = 0, numTriangles = chunk.corners.size() / 3;
+        for (unsigned int t = 0; t < numTriangles; t++)
+        {
+            while (next < switches.size() && switches[next].first <= t)
+                material = switches[next++].second;
+
+            const long* corner = &chunk.corners[3*t];
+            if (corner[0] < 0 || corner[1] < 0 || corner[2] < 0
+                || corner[0] + first >= base.back() || corner[1] + first >= base.back() || corner[2] + first >= base.back())
+            {
+                badIndices++;
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+                faces[material].push_back(corner[k] + first);
+        }
+        while (next < switches.size())
+            material = switches[next++].second;
+
+        // Chunks are not needed anymore
+        std::vector<long>().swap(chunk.corners);
+    }
+
+    if (badFaces > 0 || badIndices > 0)
+        std::cerr << "Warning: " << filename << ": skipped " << badFaces << " malformed faces and "
+            << badIndices << " triangles with vertices out of range." << std::endl;
+    return true;
+}
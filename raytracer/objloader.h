@@ -0,0 +1,73 @@
+//
+//  Framework for a raytracer
+//  File: objloader.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef OBJLOADER_H_FABIOUX_LEOBAL
+#define OBJLOADER_H_FABIOUX_LEOBAL
+
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+// Material of a model, as given by its MTL file
+struct ObjMaterial
+{
+    std::string name;
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float emissive[3];
+    float shininess; // scaled from [0, 1000] to [0, 128], as glm does
+
+    // Same defaults as glm
+    ObjMaterial(const std::string& name = "default");
+};
+
+// Wavefront OBJ model, reduced to what we render: vertex positions and
+// triangles (polygons are split into fans), sorted by material. Normals and
+// texture coordinates are skipped.
+//
+// The file is mapped in memory and cut into chunks of whole lines, parsed in
+// parallel, then the chunks are put end to end. Numbers are read by hand
+// rather than with scanf, and everything is read in a single pass.
+class ObjModel
+{
+public:
+    // materials[0] is the default material, used until the first usemtl
+    std::vector<ObjMaterial> materials;
+
+    // Triangles using each material, three vertex indices per triangle
+    std::vector<std::vector<unsigned int> > faces;
+
+    // Paths of the material libraries the file refers to
+    std::vector<std::string> libraries;
+
+    // Reads filename and the material libraries it refers to (relative to
+    // its directory). Vertices are appended to vertices, and the indices in
+    // faces include the vertices that were already there. Returns false if
+    // the file cannot be read.
+    bool read(const std::string& filename, MeshVertices* vertices, int numThreads);
+
+private:
+    void readMaterials(const std::string& filename);
+    unsigned int findMaterial(const std::string& name);
+};
+
+#endif /* end of include guard: OBJLOADER_H_FABIOUX_LEOBAL */
@@ -20,9 +20,12 @@
 //
 
 #include "plane.h"
+#include "stats.h"
 
 Hit Plane::intersect(const Ray &ray)
 {
+	RenderStats::countTests(RenderCounters::planes);
+
 	const double EPSILON = 0.0000001;
 	
 	double d = ray.D.dot(N);
@@ -42,3 +45,9 @@ bool Plane::hasWithin(Point p)
 	//TODO/FIXME
 	return false;
 }
+
+AABB Plane::bounds()
+{
+	// Planes are infinite: they are kept out of the hierarchy
+	return AABB::infinite();
+}
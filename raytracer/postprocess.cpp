@@ -0,0 +1,173 @@
+//
+//  Framework for a raytracer
+//  File: postprocess.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "postprocess.h"
+#include <algorithm>
+#include <math.h>
+#include "scheduler.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Number of colour components going through all the stages at a time, small
+// enough to stay in the L1 cache (a multiple of 6, so two whole pixels)
+#define POSTPROCESS_CHUNK 96
+
+// Tone map curve: x below the knee, a hyperbola from the knee to 1 above
+#define TONEMAP_KNEE 0.6
+#define TONEMAP_SHOULDER 0.45333
+
+void PostProcess::addExposure(double stops)
+{
+    Stage stage = { exposure, pow(2.0, stops), 0 };
+    stages.push_back(stage);
+}
+
+void PostProcess::addToneMap()
+{
+    Stage stage = { toneMapping, 0, 0 };
+    stages.push_back(stage);
+}
+
+void PostProcess::addOverlay(const Image &img, double multiplier)
+{
+    Stage stage = { overlay, multiplier, &img };
+    stages.push_back(stage);
+}
+
+void PostProcess::addClamp(double maxValue)
+{
+    Stage stage = { clamp, maxValue, 0 };
+    stages.push_back(stage);
+}
+
+void PostProcess::addGamma(double gamma)
+{
+    Stage stage = { PostProcess::gamma, 1.0 / gamma, 0 };
+    stages.push_back(stage);
+}
+
+double PostProcess::toneMap(double x)
+{
+    if (x < TONEMAP_KNEE)
+        return x;
+    double res = TONEMAP_KNEE + TONEMAP_SHOULDER - TONEMAP_SHOULDER*TONEMAP_SHOULDER / (x - TONEMAP_KNEE + TONEMAP_SHOULDER);
+    return res < 1 ? res : 1;
+}
+
+void PostProcess::apply(Image &img, int numThreads) const
+{
+    if (stages.empty())
+        return;
+
+    for (unsigned int s = 0; s < stages.size(); s++)
+        if (stages[s].type == overlay
+            && (stages[s].image->width() != img.width() || stages[s].image->height() != img.height()))
+            throw new std::string("Not the same dimensions !");
+
+    // A row of colours is a plain array of components
+    int w = img.width(), count = 3 * w;
+    TileScheduler::parallelFor(numThreads, img.height(), [&](int y, int)
+    {
+        double *row = img(0, y).data;
+        for (int start = 0; start < count; start += POSTPROCESS_CHUNK)
+        {
+            int n = std::min(POSTPROCESS_CHUNK, count - start);
+            for (unsigned int s = 0; s < stages.size(); s++)
+            {
+                const double *other = stages[s].image ? (*stages[s].image)(0, y).data + start : 0;
+                applyStage(stages[s], row + start, other, n);
+            }
+        }
+    });
+}
+
+void PostProcess::applyStage(const Stage &stage, double *values, const double *other, int count) const
+{
+    int i = 0;
+    double v = stage.value;
+
+#if defined(__SSE2__)
+    __m128d value = _mm_set1_pd(v);
+    __m128d zero = _mm_setzero_pd();
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d knee = _mm_set1_pd(TONEMAP_KNEE);
+    __m128d shoulder = _mm_set1_pd(TONEMAP_SHOULDER);
+    __m128d top = _mm_set1_pd(TONEMAP_KNEE + TONEMAP_SHOULDER);
+    __m128d shoulder2 = _mm_set1_pd(TONEMAP_SHOULDER * TONEMAP_SHOULDER);
+
+    switch (stage.type)
+    {
+    case exposure:
+        for (; i + 2 <= count; i += 2)
+            _mm_storeu_pd(values + i, _mm_mul_pd(_mm_loadu_pd(values + i), value));
+        break;
+    case toneMapping:
+        for (; i + 2 <= count; i += 2)
+        {
+            // Both sides of the curve, then the right one for each component
+            __m128d x = _mm_loadu_pd(values + i);
+            __m128d curve = _mm_sub_pd(top, _mm_div_pd(shoulder2, _mm_add_pd(_mm_sub_pd(x, knee), shoulder)));
+            curve = _mm_min_pd(curve, one);
+            __m128d below = _mm_cmplt_pd(x, knee);
+            _mm_storeu_pd(values + i, _mm_or_pd(_mm_and_pd(below, x), _mm_andnot_pd(below, curve)));
+        }
+        break;
+    case overlay:
+        for (; i + 2 <= count; i += 2)
+            _mm_storeu_pd(values + i, _mm_add_pd(_mm_loadu_pd(values + i), _mm_mul_pd(_mm_loadu_pd(other + i), value)));
+        break;
+    case clamp:
+        for (; i + 2 <= count; i += 2)
+            _mm_storeu_pd(values + i, _mm_min_pd(_mm_max_pd(_mm_loadu_pd(values + i), zero), value));
+        break;
+    case gamma:
+        // No vector pow in SSE2: left to the loop below
+        break;
+    }
+#endif
+
+    // Whatever is left (or everything, without SSE2)
+    switch (stage.type)
+    {
+    case exposure:
+        for (; i < count; i++)
+            values[i] *= v;
+        break;
+    case toneMapping:
+        for (; i < count; i++)
+            values[i] = toneMap(values[i]);
+        break;
+    case overlay:
+        for (; i < count; i++)
+            values[i] += other[i] * v;
+        break;
+    case clamp:
+        for (; i < count; i++)
+            values[i] = std::min(std::max(values[i], 0.0), v);
+        break;
+    case gamma:
+        for (; i < count; i++)
+            values[i] = pow(values[i], v);
+        break;
+    }
+}
@@ -0,0 +1,72 @@
+//
+//  Framework for a raytracer
+//  File: postprocess.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef POSTPROCESS_H_FABIOUX_LEOBAL
+#define POSTPROCESS_H_FABIOUX_LEOBAL
+
+#include <vector>
+#include "image.h"
+
+// A list of operations on the colours of an image, applied in the order they
+// were added. All of them work on each colour component independently, so
+// the whole list is applied in a single pass over the image: rows are shared
+// between threads, and each row goes through all the stages a few pixels at
+// a time, two components at once with SSE2.
+class PostProcess
+{
+public:
+    // Multiplies by 2^stops
+    void addExposure(double stops);
+    // Keeps values below 0.6 and compresses the ones above into [0.6, 1]
+    void addToneMap();
+    // Adds multiplier times the same pixel of img, which must be the same
+    // size and stay alive as long as the pipeline is used
+    void addOverlay(const Image &img, double multiplier=1);
+    // Clamps to [0, maxValue]
+    void addClamp(double maxValue=1);
+    // Raises to the power 1/gamma (values must be positive)
+    void addGamma(double gamma);
+
+    bool isEmpty() const { return stages.empty(); }
+
+    void apply(Image &img, int numThreads=1) const;
+
+    // Tone map curve, one value at a time
+    static double toneMap(double x);
+
+private:
+    enum StageType {
+        exposure, toneMapping, overlay, clamp, gamma
+    };
+
+    struct Stage
+    {
+        StageType type;
+        double value;
+        const Image *image;
+    };
+
+    std::vector<Stage> stages;
+
+    void applyStage(const Stage &stage, double *values, const double *other, int count) const;
+};
+
+#endif /* end of include guard: POSTPROCESS_H_FABIOUX_LEOBAL */
@@ -23,18 +23,28 @@
 #include "triangle.h"
 #include "cylinder.h"
 #include "plane.h"
+#include "mesh.h"
+#include "instance.h"
+#include "objloader.h"
+#include "meshcache.h"
+#include "scheduler.h"
 #include "material.h"
 #include "light.h"
 #include "image.h"
 #include "yaml/yaml.h"
 #include "glm.h"
 #include <ctype.h>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <assert.h>
 
 // Functions to ease reading from YAML input
 void operator >> (const YAML::Node& node, Triple& t);
 Triple parseTriple(const YAML::Node& node);
+template <typename T>
+T readOptional(const YAML::Node& node, const char* key, const T& defaultValue);
 
 void operator >> (const YAML::Node& node, Triple& t)
 {
@@ -53,25 +63,31 @@ Triple parseTriple(const YAML::Node& node)
     return t;
 }
 
+// Reads the value of an optional key, or returns defaultValue if the node
+// has no such key. Missing keys are looked up with FindValue rather than by
+// catching the exception of operator[], which costs far more than the lookup.
+template <typename T>
+T readOptional(const YAML::Node& node, const char* key, const T& defaultValue)
+{
+    const YAML::Node* value = node.FindValue(key);
+    if (!value)
+        return defaultValue;
+    T t;
+    *value >> t;
+    return t;
+}
+
 Material* Raytracer::parseMaterial(const YAML::Node& node)
 {
     Material *m = new Material();
-    try
-    { node["opacity"] >> m->opacity;}
-	catch (...)
-	{ m->opacity = 1.0;}
-	try
-	{ node["eta"] >> m->eta;}
-	catch (...)
-	{ m->eta=1.0; }
-	try
-	{
-		std::string s ;
-		node["texture"] >> s;
-		m->texture = new Image(s.c_str());
+    m->opacity = readOptional(node, "opacity", 1.0);
+    m->eta = readOptional(node, "eta", 1.0);
+    if (const YAML::Node* texture = node.FindValue("texture"))
+    {
+        std::string s;
+        *texture >> s;
+        m->texture = Texture::load(s);
     }
-	catch (...)
-	{ m->texture=NULL; }
     node["color"] >> m->color;	
     node["ka"] >> m->ka;
     node["kd"] >> m->kd;
@@ -80,6 +96,28 @@ Material* Raytracer::parseMaterial(const YAML::Node& node)
     return m;
 }
 
+static const char* builderName(BVH::Builder builder)
+{
+    return builder == BVH::lbvh ? "lbvh" : "sah";
+}
+
+/**
+ * Reads the options of a model node that loadModel uses: its file, loader
+ * and whether it is cached.
+ */
+static void readModelOptions(const YAML::Node& node, string& fileName, string& loader, bool& cache)
+{
+    node["file"] >> fileName;
+
+    // "loader: glm" reads the file with the original two-pass loader,
+    // for comparison
+    loader = readOptional(node, "loader", string("obj"));
+
+    // Models read by the obj loader are cached next to their file, with
+    // their meshes built ("cache: false" to always read the OBJ file)
+    cache = readOptional(node, "cache", true) && loader != "glm";
+}
+
 vector<Object*> Raytracer::parseObject(const YAML::Node& node)
 {
     std::string objectType;
@@ -93,18 +131,9 @@ vector<Object*> Raytracer::parseObject(const YAML::Node& node)
         double r;
         node["radius"] >> r;
         
-        Vector up;
-        try
-		{ node["up"] >> up;}
-		catch (...)
-		{ up = Vector(0,0,1); }
-		
-		double spin;
-		try
-		{ node["spin"] >> spin;}
-		catch (...)
-		{ spin=0.0; }
-		
+        Vector up = readOptional(node, "up", Vector(0,0,1));
+        double spin = readOptional(node, "spin", 0.0);
+
 		Sphere *sphere = new Sphere(pos,r,up,spin);
         sphere->material = parseMaterial(node["material"]);
         objs.push_back(sphere);
@@ -145,99 +174,264 @@ vector<Object*> Raytracer::parseObject(const YAML::Node& node)
     else if(objectType == "model")
     {
         // Reading model parameters
-        GLMmodel* model; 
         Point p;
-        double size;
-        string fileName;
-        node["file"] >> fileName;
-        model = glmReadOBJ(&fileName[0u]);
+        double size = 1.0;
 
         // Sets the position to (0, 0, 0) and scale it to fit into a 1x1x1 cube
         //double factor = (double) glmUnitize(model);
-        try // Set a position other than (0, 0, 0) if wanted
+        // Set a position other than (0, 0, 0) if wanted
+        p = readOptional(node, "position", p);
+        // Scale it to the wanted size, or give back its original size
+        size = readOptional(node, "size", size);
+        //    glmScale(model, (float)(1.0 / factor));
+
+        MeshCache::Model model;
+        if(!loadModel(node, size, p, model))
+            return objs;
+
+        Material* material = nullptr;
+        const YAML::Node* uniform = node.FindValue("material");
+        bool uniformMaterial = uniform != nullptr;
+        if(uniformMaterial) // Same material for all triangles
+            material = parseMaterial(*uniform);
+
+        for(unsigned int m = 0; m < model.meshes.size(); m++)
+        {
+            if(!uniformMaterial) // Material is specific to group
+                material = objMaterial(model.materials[model.meshMaterials[m]]);
+            model.meshes[m]->material = material;
+            objs.push_back(model.meshes[m]);
+        }
+    }
+    else if(objectType == "instance")
+    {
+        // The model is read once, in its own coordinates, whatever the number
+        // of its instances. Instances asking for other loading options get a
+        // model of their own.
+        string fileName, loader;
+        bool cache;
+        readModelOptions(node, fileName, loader, cache);
+        std::ostringstream key;
+        key << fileName << '\n' << loader << '\n' << cache << '\n'
+            << builderName(scene->getBuilder()) << '\n' << scene->getWideBVH();
+        SharedModel*& shared = sharedModels[key.str()];
+        if(!shared)
+        {
+            shared = new SharedModel();
+            if(!loadModel(node, 1.0, Point(), shared->model))
+            {
+                delete shared;
+                shared = nullptr;
+                sharedModels.erase(key.str());
+                return objs;
+            }
+            for(unsigned int m = 0; m < shared->model.meshes.size(); m++)
+                shared->materials.push_back(objMaterial(shared->model.materials[shared->model.meshMaterials[m]]));
+        }
+
+        // Either a whole matrix (3 rows of 4, the last column being the
+        // translation), or the same size and position as models, with an
+        // optional scale per axis and rotations (in degrees, around x, then
+        // y, then z)
+        Transform transform;
+        if(const YAML::Node* matrix = node.FindValue("matrix"))
         {
-            node["position"] >> p;
-            model->position[0] = p.x;
-            model->position[1] = p.y;
-            model->position[2] = p.z;
+            for(int i = 0; i < 3; i++)
+                for(int j = 0; j < 4; j++)
+                    (*matrix)[i][j] >> transform.m[i][j];
         }
-        catch(YAML::TypedKeyNotFound<std::string>) {}
-        try // Scale it to the wanted size
+        else
         {
-            node["size"] >> size;
-            glmScale(model, size);
+            double size = readOptional(node, "size", 1.0);
+            Vector scale = readOptional(node, "scale", Vector(1.0, 1.0, 1.0));
+            Vector rotation = readOptional(node, "rotation", Vector());
+            transform = Transform::translation(readOptional(node, "position", Point()))
+                * Transform::rotation(2, rotation.z)
+                * Transform::rotation(1, rotation.y)
+                * Transform::rotation(0, rotation.x)
+                * Transform::scaling(scale * size);
         }
-        catch(YAML::TypedKeyNotFound<std::string>) // Give back its original size
+        Transform inverse;
+        if(!transform.inverse(inverse))
         {
-        //    glmScale(model, (float)(1.0 / factor));
+            cerr << "Warning: instance of " << fileName << " has a singular transform, ignored." << endl;
+            return objs;
         }
 
         Material* material = nullptr;
-        bool uniformMaterial;
-        try // Same material for all triangles
-        {
-            material = parseMaterial(node["material"]);
-            uniformMaterial = true;
-        }
-        catch(YAML::TypedKeyNotFound<std::string>)
+        if(const YAML::Node* uniform = node.FindValue("material"))
+            material = parseMaterial(*uniform);
+
+        for(unsigned int m = 0; m < shared->model.meshes.size(); m++)
         {
-            uniformMaterial = false;
+            Instance* instance = new Instance(shared->model.meshes[m], transform);
+            instance->material = material ? material : shared->materials[m];
+            objs.push_back(instance);
         }
+    }
+    return objs;
+}
 
-        // Converting model into triangles
-        GLMgroup* group = model->groups;
-        while(group != nullptr)
+// SAH cost of a model: that of each mesh, weighted by the chance that a ray
+// hitting the bounds of the model hits those of the mesh
+static double modelCost(const MeshCache::Model& model)
+{
+    AABB bounds;
+    for(unsigned int m = 0; m < model.meshes.size(); m++)
+        bounds.extend(model.meshes[m]->bounds());
+    if(!(bounds.area() > 0))
+        return 0.0;
+    double cost = 0.0;
+    for(unsigned int m = 0; m < model.meshes.size(); m++)
+        cost += model.meshes[m]->getSahCost() * model.meshes[m]->bounds().area();
+    return cost / bounds.area();
+}
+
+/**
+ * Reads the model file of node, with its size multiplied by size and moved
+ * to position, and builds its meshes: from the cache of the file if it has
+ * one for this transform, else from the file itself. Returns false if the
+ * file could not be read.
+ */
+bool Raytracer::loadModel(const YAML::Node& node, double size, const Point& p, MeshCache::Model& model)
+{
+    string fileName, loader;
+    bool cache;
+    readModelOptions(node, fileName, loader, cache);
+
+    RenderStats::Timer loadTimer(stats, RenderStats::load);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    model.builder = scene->getBuilder();
+    model.wide = scene->getWideBVH();
+    if(cache && MeshCache::load(fileName, size, p, model))
+    {
+        // Formatted apart, so that cout keeps its own precision
+        std::ostringstream line;
+        line << "Model " << fileName << ": loaded from cache in " << std::fixed << std::setprecision(3)
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+            << "s (read and built in " << model.buildSeconds << "s), "
+            << builderName(model.builder) << " SAH cost " << modelCost(model);
+        cout << line.str() << endl;
+    }
+    else
+    {
+        // Vertices are shared by the meshes of all groups
+        MeshVertices* vertices = new MeshVertices();
+        model.vertices = vertices;
+        int threads = scene->getNumThreads() > 0 ? scene->getNumThreads() : TileScheduler::defaultThreads();
+        std::vector<unsigned int> groupMaterials;
+        std::vector<std::vector<unsigned int> > groupFaces;
+        if (loader == "glm")
         {
-            if(!uniformMaterial) // Material is specific to group
+            GLMmodel* glmModel = glmReadOBJ(&fileName[0u]);
+
+            // GLM indices start at 1: vertex 0 is unused, but kept so that
+            // indices can be used as is.
+            for(unsigned int i = 0; i <= glmModel->numvertices; i++)
+            {
+                vertices->add(
+                    glmModel->vertices[i*3+0],
+                    glmModel->vertices[i*3+1],
+                    glmModel->vertices[i*3+2]);
+            }
+            for(unsigned int i = 0; i < glmModel->nummaterials; i++)
+            {
+                GLMmaterial& from = glmModel->materials[i];
+                ObjMaterial to(from.name ? from.name : "");
+                for(int k = 0; k < 3; k++)
+                {
+                    to.ambient[k] = from.ambient[k];
+                    to.diffuse[k] = from.diffuse[k];
+                    to.specular[k] = from.specular[k];
+                    to.emissive[k] = from.emmissive[k];
+                }
+                to.shininess = from.shininess;
+                model.materials.push_back(to);
+            }
+            if (model.materials.empty())
+                model.materials.push_back(ObjMaterial());
+
+            for(GLMgroup* group = glmModel->groups; group != nullptr; group = group->next)
             {
-                material = new Material();
-                material->color.r = (double) model->materials[group->material].emmissive[0];
-                material->color.g = (double) model->materials[group->material].emmissive[1];
-                material->color.b = (double) model->materials[group->material].emmissive[2];
-                // Since we have implemented ka, kd and ks as intensities and not RGB components,
-                // we average the intensities from the specified RGB components.
-                material->ka = (double) (
-                    model->materials[group->material].ambient[0]
-                    + model->materials[group->material].ambient[1]
-                    + model->materials[group->material].ambient[2] ) / 3.0;
-                material->kd = (double) (
-                    model->materials[group->material].diffuse[0]
-                    + model->materials[group->material].diffuse[1]
-                    + model->materials[group->material].diffuse[2] ) / 3.0;
-                material->ks = (double) (
-                    model->materials[group->material].specular[0]
-                    + model->materials[group->material].specular[1]
-                    + model->materials[group->material].specular[2] ) / 3.0;
-                material->n = (double) model->materials[group->material].shininess;
+                groupMaterials.push_back(group->material);
+                groupFaces.push_back(std::vector<unsigned int>());
+                for(unsigned int i = 0; i < group->numtriangles; i++)
+                {
+                    GLMtriangle* triangle = &glmModel->triangles[group->triangles[i]];
+                    groupFaces.back().insert(groupFaces.back().end(), triangle->vindices, triangle->vindices + 3);
+                }
             }
 
-            for(unsigned int i = 0; i < group->numtriangles; i++)
+            // Deleting model
+            glmDelete(glmModel);
+        }
+        else
+        {
+            if (loader != "obj")
+                cerr << "Warning: unknown model loader " << loader << ", using obj." << endl;
+            ObjModel objModel;
+            if (!objModel.read(fileName, vertices, threads))
             {
-                GLMtriangle* triangle = &model->triangles[group->triangles[i]];
-                Triangle* newTriangle = new Triangle(Point(
-                    (double) model->vertices[triangle->vindices[0]*3+0] + model->position[0],
-                    (double) model->vertices[triangle->vindices[0]*3+1] + model->position[1],
-                    (double) model->vertices[triangle->vindices[0]*3+2] + model->position[2]
-                    ),  Point(
-                    (double) model->vertices[triangle->vindices[1]*3+0] + model->position[0],
-                    (double) model->vertices[triangle->vindices[1]*3+1] + model->position[1],
-                    (double) model->vertices[triangle->vindices[1]*3+2] + model->position[2]
-                    ), Point(
-                    (double) model->vertices[triangle->vindices[2]*3+0] + model->position[0],
-                    (double) model->vertices[triangle->vindices[2]*3+1] + model->position[1],   
-                    (double) model->vertices[triangle->vindices[2]*3+2] + model->position[2]
-                    ));
-                newTriangle->material = material;
-                objs.push_back(newTriangle);
+                delete vertices;
+                return false;
+            }
+            model.materials = objModel.materials;
+            model.libraries = objModel.libraries;
+            for(unsigned int i = 0; i < objModel.faces.size(); i++)
+            {
+                groupMaterials.push_back(i);
+                groupFaces.push_back(std::vector<unsigned int>());
+                groupFaces.back().swap(objModel.faces[i]);
             }
-            group = group->next;
         }
 
-        // Deleting model
-        glmDelete(model);
+        for(unsigned int i = 0; i < vertices->size(); i++)
+        {
+            // Same operations as glmScale, then adding the position, in float
+            vertices->x[i] = vertices->x[i] * (float)size + (float)p.x;
+            vertices->y[i] = vertices->y[i] * (float)size + (float)p.y;
+            vertices->z[i] = vertices->z[i] * (float)size + (float)p.z;
+        }
+
+        // Converting each group into a mesh
+        for(unsigned int g = 0; g < groupFaces.size(); g++)
+        {
+            if(groupFaces[g].empty())
+                continue;
+            Mesh* mesh = new Mesh(vertices);
+            for(unsigned int i = 0; i + 2 < groupFaces[g].size(); i += 3)
+                mesh->addFace(groupFaces[g][i], groupFaces[g][i+1], groupFaces[g][i+2]);
+            RenderStats::Timer buildTimer(stats, RenderStats::build);
+            mesh->build(model.builder, threads, model.wide);
+            model.meshes.push_back(mesh);
+            model.meshMaterials.push_back(groupMaterials[g]);
+        }
+
+        model.buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::ostringstream line;
+        line << "Model " << fileName << ": read and built in " << std::fixed << std::setprecision(3)
+            << model.buildSeconds << "s, " << builderName(model.builder) << " SAH cost "
+            << modelCost(model);
+        cout << line.str() << endl;
+        if(cache)
+            MeshCache::save(fileName, size, p, model);
     }
+    return true;
+}
 
-    return objs;
+Material* Raytracer::objMaterial(const ObjMaterial& from)
+{
+    Material* material = new Material();
+    material->color.r = (double) from.emissive[0];
+    material->color.g = (double) from.emissive[1];
+    material->color.b = (double) from.emissive[2];
+    // Since we have implemented ka, kd and ks as intensities and not RGB components,
+    // we average the intensities from the specified RGB components.
+    material->ka = (double) (from.ambient[0] + from.ambient[1] + from.ambient[2]) / 3.0;
+    material->kd = (double) (from.diffuse[0] + from.diffuse[1] + from.diffuse[2]) / 3.0;
+    material->ks = (double) (from.specular[0] + from.specular[1] + from.specular[2]) / 3.0;
+    material->n = (double) from.shininess;
+    return material;
 }
 
 Light* Raytracer::parseLight(const YAML::Node& node)
@@ -255,8 +449,11 @@ Light* Raytracer::parseLight(const YAML::Node& node)
 
 bool Raytracer::readScene(const std::string& inputFilename)
 {
+    RenderStats::Timer timer(stats, RenderStats::parse);
+
     // Initialize a new scene
     scene = new Scene();
+    scene->setStats(stats);
 
     // Open file stream for reading and have the YAML module parse it
     std::ifstream fin(inputFilename.c_str());
@@ -270,13 +467,11 @@ bool Raytracer::readScene(const std::string& inputFilename)
             YAML::Node doc;
             parser.GetNextDocument(doc);
 
-            std::string renderMode;
-            try
-            { doc["RenderMode"] >> renderMode; }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { renderMode = "phong"; }
+            std::string renderMode = readOptional(doc, "RenderMode", std::string("phong"));
 			
-			if (renderMode == "normal")
+			if (renderMode == "phong")
+				scene->setRenderMode(Scene::phong);
+			else if (renderMode == "normal")
 				scene->setRenderMode(Scene::normal);
             else if (renderMode == "zbuffer")
             {
@@ -301,79 +496,144 @@ bool Raytracer::readScene(const std::string& inputFilename)
                 scene->setAlpha(gooch["alpha"]);
                 scene->setBeta(gooch["beta"]);
             }
+            else if (renderMode == "cost")
+            {
+                // What is measured per pixel (tests, nodes or time), and how
+                // it is shown
+                scene->setRenderMode(Scene::cost);
+                if (const YAML::Node* costNode = doc.FindValue("CostParameters"))
+                {
+                    const YAML::Node& cost = *costNode;
+                    std::string measure = readOptional(cost, "measure", std::string("tests"));
+                    if (measure == "nodes")
+                        scene->setCostMeasure(Scene::costNodes);
+                    else if (measure == "time")
+                        scene->setCostMeasure(Scene::costTime);
+                    else if (measure != "tests")
+                        cerr << "Warning: unknown cost measure " << measure << ", using tests." << endl;
+                    scene->setCostLogScale(readOptional(cost, "log", true));
+                    scene->setCostLegend(readOptional(cost, "legend", true));
+                }
+            }
+            else
+                cerr << "Warning: unknown render mode " << renderMode << ", using phong." << endl;
 
             // Read whether shadows should be used or not
-            try
-            { scene->setEnableShadows(doc["Shadows"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setEnableShadows(false); }
+            scene->setEnableShadows(readOptional(doc, "Shadows", false));
             
             // Read the number of recursions for reflexions
-            try
-            { scene->setMaxRecursionDepth(doc["MaxRecursionDepth"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setMaxRecursionDepth(0); }
+            scene->setMaxRecursionDepth(readOptional(doc, "MaxRecursionDepth", 0));
+
+            // Read when secondary rays stop being worth tracing: below a
+            // weight (their share of the pixel colour), by Russian roulette
+            // below another (0 to disable), or once the pixel has traced
+            // RayBudget of them (0 for no limit)
+            scene->setMinRayWeight(readOptional(doc, "MinRayWeight", 0.0));
+            scene->setRouletteWeight(readOptional(doc, "RussianRoulette", 0.0));
+            scene->setRayBudget(readOptional(doc, "RayBudget", 0));
 
             // Read the optional progression printing parameter
-            try
-            { scene->setPrintProgression(doc["PrintProgression"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setPrintProgression(0.0f); }
+            scene->setPrintProgression(readOptional(doc, "PrintProgression", 0.0f));
 
             // Read camera configuration
-            try
+            if (const YAML::Node* eyeNode = doc.FindValue("Eye"))
             { 
                 // Old camera "Eye" : has default parameters
-                Triple eye = doc["Eye"];
-                scene->setEye(parseTriple(doc["Eye"]));
+                Triple eye = parseTriple(*eyeNode);
+                scene->setEye(eye);
                 scene->setLookAt(Vector(eye.x, eye.y, eye.z - 1.0));
                 scene->setUpVector(Vector(0.0, 22.6198649, 0.0));
                 scene->setWidth(400);
                 scene->setHeight(400);
             }
-            catch(YAML::TypedKeyNotFound<std::string>)
+            else if (const YAML::Node* cameraNode = doc.FindValue("Camera"))
             {
-                try
-                    {
-                    const YAML::Node& camera = doc["Camera"];
-                    scene->setEye(parseTriple(camera["position"]));
-                    scene->setLookAt(parseTriple(camera["lookat"]));
-                    scene->setUpVector(parseTriple(camera["up"]));
-                    scene->setWidth(camera["resolution"][0]);
-                    scene->setHeight(camera["resolution"][1]);
-                }
-                catch(YAML::TypedKeyNotFound<std::string> error)
-                {
-                    cerr << "Error: expected a camera or an eye definition." << endl;
-                    return false;
-                }
+                const YAML::Node& camera = *cameraNode;
+                scene->setEye(parseTriple(camera["position"]));
+                scene->setLookAt(parseTriple(camera["lookat"]));
+                scene->setUpVector(parseTriple(camera["up"]));
+                scene->setWidth(camera["resolution"][0]);
+                scene->setHeight(camera["resolution"][1]);
             }
-			try
-            { scene->setsuperSamplingMult(doc["SuperSampling"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setsuperSamplingMult(1); }
+            else
+            {
+                cerr << "Error: expected a camera or an eye definition." << endl;
+                return false;
+            }
+            scene->setsuperSamplingMult(readOptional(doc, "SuperSampling", 1));
+
+            // Read adaptive supersampling: pixels whose samples have a
+            // standard deviation above the threshold get MaxSuperSampling
+            // samples more (0 to disable)
+            scene->setAdaptiveThreshold(readOptional(doc, "AdaptiveThreshold", 0.0));
+
+            scene->setMaxSuperSamplingMult(readOptional(doc, "MaxSuperSampling", 4));
             
-            try
-            { scene->setEnableDepthOfField(doc["DepthOfField"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setEnableDepthOfField(false); }
+            // Read whether primary rays are traced by packets (same image,
+            // faster)
+            scene->setUsePackets(readOptional(doc, "RayPackets", true));
+
+            // Read how secondary rays are traced: recursively (the default),
+            // or bounce by bounce in sorted order (same image, but for the
+            // random choices of RussianRoulette and RayBudget; not faster
+            // yet, only there to be measured)
+            std::string integrator = readOptional(doc, "Integrator", std::string("recursive"));
+            if (integrator == "wavefront")
+                scene->setIntegrator(Scene::wavefront);
+            else if (integrator != "recursive")
+                cerr << "Warning: unknown integrator " << integrator << ", using recursive." << endl;
+
+            // Read the post-processing of the colours: exposure (in stops),
+            // tone mapping of the highlights and gamma correction
+            scene->setExposure(readOptional(doc, "Exposure", 0.0));
+
+            scene->setToneMapping(readOptional(doc, "ToneMapping", true));
+
+            scene->setGamma(readOptional(doc, "Gamma", 1.0));
+
+            // Read the number of threads used to load, build and render
+            // (0 for one per core), unless it was set already
+            scene->setNumThreads(numThreads >= 0 ? numThreads : readOptional(doc, "Threads", 0));
+
+            scene->setEnableDepthOfField(readOptional(doc, "DepthOfField", false));
             
-            try
-            { scene->setApertureDiameter(doc["ApertureDiameter"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setApertureDiameter(1.0); }
+            scene->setApertureDiameter(readOptional(doc, "ApertureDiameter", 1.0));
             
-            try
-            { scene->setFocalLength(doc["FocalLength"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setFocalLength(0.5); }
+            scene->setFocalLength(readOptional(doc, "FocalLength", 0.5));
             
-            try
-            { scene->setFocusDistance(doc["FocusDistance"]); }
-            catch (YAML::TypedKeyNotFound<std::string>)
-            { scene->setFocusDistance(50); }
+            scene->setFocusDistance(readOptional(doc, "FocusDistance", 50.0));
 
 
+            // Read which acceleration structure to use: "none" to test every
+            // object for every ray, for comparison, or a BVH, given either as
+            // "bvh" or as {builder: sah|lbvh, width: 4|2}. Width 2 keeps the
+            // binary tree instead of collapsing it into wide nodes. Read
+            // before the objects, whose meshes are built as they are loaded.
+            std::string accelerator = "bvh", builder = "sah";
+            int width = WIDE_NODE_WIDTH;
+            if (const YAML::Node* acceleratorNode = doc.FindValue("Accelerator"))
+            {
+                if (acceleratorNode->GetType() == YAML::CT_MAP)
+                {
+                    builder = readOptional(*acceleratorNode, "builder", builder);
+                    width = readOptional(*acceleratorNode, "width", width);
+                }
+                else
+                    *acceleratorNode >> accelerator;
+            }
+            if (accelerator == "none")
+                scene->setUseAccelerator(false);
+            else if (accelerator != "bvh")
+                cerr << "Warning: unknown accelerator " << accelerator << ", using bvh." << endl;
+            if (builder == "lbvh")
+                scene->setBuilder(BVH::lbvh);
+            else if (builder != "sah")
+                cerr << "Warning: unknown BVH builder " << builder << ", using sah." << endl;
+            if (width == 2)
+                scene->setWideBVH(false);
+            else if (width != WIDE_NODE_WIDTH)
+                cerr << "Warning: unsupported BVH width " << width << ", using " << WIDE_NODE_WIDTH << "." << endl;
+
             // Read and parse the scene objects
             const YAML::Node& sceneObjects = doc["Objects"];
             if (sceneObjects.GetType() != YAML::CT_SEQUENCE) {
@@ -406,9 +666,25 @@ bool Raytracer::readScene(const std::string& inputFilename)
     } catch(YAML::ParserException& e) {
         std::cerr << "Error at line " << e.mark.line + 1 << ", col " << e.mark.column + 1 << ": " << e.msg << std::endl;
         return false;
+    } catch(YAML::RepresentationException& e) {
+        // Missing required key, or value of the wrong type
+        std::cerr << "Error at line " << e.mark.line + 1 << ", col " << e.mark.column + 1 << ": " << e.msg << std::endl;
+        return false;
     }
 
     cout << "YAML parsing results: " << scene->getNumObjects() << " objects read." << endl;
+    RenderStats::Timer buildTimer(stats, RenderStats::build);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scene->buildAccelerator();
+    if (scene->getUseAccelerator())
+    {
+        std::ostringstream line;
+        line << "Scene BVH: built in " << std::fixed << std::setprecision(3)
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+            << "s, " << builderName(scene->getBuilder()) << " SAH cost "
+            << scene->getAcceleratorCost();
+        cout << line.str() << endl;
+    }
     return true;
 }
 
@@ -418,6 +694,8 @@ void Raytracer::renderToFile(const std::string& outputFilename)
     cout << "Tracing..." << endl;
     scene->render(img);
     cout << "Writing image to " << outputFilename << "..." << endl;
+    RenderStats::Timer timer(stats, RenderStats::encode);
     img.write_png(outputFilename.c_str());
+    timer.stop();
     cout << "Done." << endl;
 }
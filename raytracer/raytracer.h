@@ -21,26 +21,53 @@
 #define RAYTRACER_H_6GQO67WK
 
 #include <iostream>
+#include <map>
 #include <string>
 #include "triple.h"
 #include "light.h"
 #include "scene.h"
+#include "stats.h"
+#include "meshcache.h"
 #include "yaml/yaml.h"
 
 class Raytracer {
 private:
     Scene *scene;
+    RenderStats *stats;
+    int numThreads; // -1: as given by the scene file
+
+    // Models read once and shared by all their instances, by file name and
+    // loading options (see the instance objects in parseObject)
+    struct SharedModel
+    {
+        MeshCache::Model model;
+        std::vector<Material*> materials; // of each mesh, from the model file
+    };
+    std::map<std::string, SharedModel*> sharedModels;
 
     // Couple of private functions for parsing YAML nodes
     Material* parseMaterial(const YAML::Node& node);
     vector<Object*> parseObject(const YAML::Node& node);
     Light* parseLight(const YAML::Node& node);
+    bool loadModel(const YAML::Node& node, double size, const Point& position, MeshCache::Model& model);
+    Material* objMaterial(const ObjMaterial& from);
 
 public:
-    Raytracer() { }
+    Raytracer() : scene(NULL), stats(NULL), numThreads(-1) { }
 
     bool readScene(const std::string& inputFilename);
     void renderToFile(const std::string& outputFilename);
+
+    // Overrides the number of threads given in the scene file (0 for one
+    // per core), for loading and building as well when called before
+    // readScene
+    void setNumThreads(int n) { numThreads = n; if (scene) scene->setNumThreads(n); }
+
+    // Counts and times everything from now on into stats (before readScene
+    // to time the parsing)
+    void setStats(RenderStats *value) { stats = value; if (scene) scene->setStats(value); }
+
+    Scene* getScene() { return scene; }
 };
 
 #endif /* end of include guard: RAYTRACER_H_6GQO67WK */
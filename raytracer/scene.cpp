@@ -21,6 +21,23 @@
 
 #include "scene.h"
 #include "material.h"
+#include "costmap.h"
+#include "depthoffield.h"
+#include "postprocess.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+
+// Rays never hit the object they start from, except meshes, which only skip
+// the face the ray starts from (see Mesh::intersect), and objects the ray
+// was refracted into, which it has to leave.
+static inline bool startsFrom(const Ray &ray, const Object *obj)
+{
+    return obj == ray.origin && ray.originFace < 0 && !ray.isInside(obj);
+}
 
 Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
 {
@@ -29,18 +46,17 @@ Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
 	
     // Find hit object and distance
     Hit min_hit(std::numeric_limits<double>::infinity(),Vector());
-    Object *obj = NULL;
-    for (unsigned int i = 0; i < objects.size(); ++i) {
-        if(objects[i] != ray.origin)
-        {
-            Hit hit(objects[i]->intersect(ray));
-            if (hit.t<min_hit.t) {
-                min_hit = hit;
-                obj = objects[i];
-            }
-        }
-    }
-	
+    Object *obj = intersect(ray, min_hit);
+
+    return shade(ray, obj, min_hit, recursionDepth, depth_p);
+}
+
+/**
+ * Computes the color seen along the ray, which hit obj (NULL if none) at
+ * min_hit, with the kernel selected for the scene (see selectKernel).
+ */
+Color Scene::shade(const Ray &ray, Object *obj, const Hit &min_hit, int recursionDepth, double* depth_p)
+{
 	if (depth_p)
 	{
 		if (!obj)
@@ -49,15 +65,35 @@ Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
 			*depth_p = min_hit.t;
 	}
 
+    return (this->*kernel)(ray, obj, min_hit, recursionDepth);
+}
+
+/**
+ * trace, for the secondary rays of a kernel, which use the same kernel
+ */
+template <Scene::RenderMode mode, int features>
+Color Scene::traceKernel(const Ray &ray, int recursionDepth)
+{
+	if (recursionDepth > maxRecursionDepth)
+		return Color(0.0, 0.0, 0.0);
+
+    Hit min_hit(std::numeric_limits<double>::infinity(),Vector());
+    Object *obj = intersect(ray, min_hit);
+
+    return shadeKernel<mode, features>(ray, obj, min_hit, recursionDepth);
+}
+
+/**
+ * Shading of one render mode, with only the features the scene uses
+ * (KERNEL_* flags). Secondary rays are traced from here, recursively.
+ */
+template <Scene::RenderMode mode, int features>
+Color Scene::shadeKernel(const Ray &ray, Object *obj, const Hit &min_hit, int recursionDepth)
+{
     // No hit? Return background color.
     if (!obj) return Color(0.0, 0.0, 0.0);
 
-    Material *material = obj->material;            //the hit objects material
-    Point hit = ray.at(min_hit.t);                 //the hit point
-    Vector N = min_hit.N;                          //the normal at hit point
-    Vector V = -ray.D;                             //the view vector
-
-    switch(renderMode)
+    switch(mode) // known at compile time: only one case is kept
     {
         case zbuffer: // Display zbuffer values as a grayscale
         {
@@ -73,12 +109,19 @@ Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
         }
         case normal: // Display normals components as RGB colors
         {
-            return Color((N + Vector(1.0, 1.0, 1.0)) / 2.0);
+            return Color((min_hit.N + Vector(1.0, 1.0, 1.0)) / 2.0);
         }
         case gooch: // Gooch illumination model
         {
+            Material *material = obj->material;            //the hit objects material
+            Point hit = ray.at(min_hit.t);                 //the hit point
+            Vector N = min_hit.N;                          //the normal at hit point
+            Vector V = -ray.D;                             //the view vector
+            double footprint = ray.footprint(min_hit.t);   //the width of the ray there
+            Color surfaceColor = (features & KERNEL_TEXTURES)  //the colour there
+                ? obj->colorAt(hit, footprint) : material->color;
             Color diffuse, specular, reflection;
-            Color materialColor = obj->colorAt(hit);
+            Color materialColor = surfaceColor;
             Color kCool = Color(0, 0, b) + alpha*materialColor;
             Color kWarm = Color(y, y, 0) + beta*materialColor;
             for(unsigned int i = 0; i < lights.size(); i++)
@@ -87,7 +130,7 @@ Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
                 Vector L = (lights[i]->position - hit).normalized();
 
                 // Computing per-light components of Gooch model
-                if(!enableShadows || !checkShadow(obj, hit, min_hit, L))
+                if(!(features & KERNEL_SHADOWS) || !checkShadow(obj, min_hit.face, hit, lights[i]->position))
                 {
                     // Using the Gooch shading formula
                     diffuse += kCool *(1 - L.dot(N))/2 + kWarm * (1 + L.dot(N))/2;
@@ -101,13 +144,22 @@ Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
                     if(angle > 0)
                         specular += pow(angle, material->n) * lights[i]->color;
                 }
+            }
 
-                // Reflections
-                Vector n = N.normalized();
-                Vector refl = ray.D -  2 * (ray.D.dot(n)) * n;
+            // Reflections (the same for every light: traced once)
+            Vector n = N.normalized();
+            Vector refl = ray.D -  2 * (ray.D.dot(n)) * n;
 
-                Ray reflRay = Ray(hit, refl, obj);
-                reflection = trace(reflRay, recursionDepth+1);
+            Ray reflRay = Ray(hit, refl, obj, ray.eta);
+            double scale;
+            if (!lights.empty() && (scale = spawn(ray, material->ks, reflRay)) > 0)
+            {
+                reflRay.copyMedia(ray);
+                reflRay.originFace = min_hit.face;
+                reflRay.coneWidth = footprint;
+                reflRay.coneSpread = ray.coneSpread;
+                RenderStats::countRay(RenderCounters::reflectionRays);
+                reflection = scale * traceKernel<mode, features>(reflRay, recursionDepth+1);
             }
 
             return diffuse * material->kd
@@ -115,111 +167,525 @@ Color Scene::trace(const Ray &ray, int recursionDepth, double* depth_p)
         }
         default: // Phong rendering
         {
-            // Computing of the color using the Phong reflection model:
-            // https://en.wikipedia.org/wiki/Phong_reflection_model
+            auto follow = [&](const Ray &child, double factor)
+            {
+                return factor * traceKernel<mode, features>(child, recursionDepth+1);
+            };
+            auto shadowed = [&](unsigned int i, const Point &hit)
+            {
+                return checkShadow(obj, min_hit.face, hit, lights[i]->position);
+            };
+            return shadePhong<features>(ray, obj, min_hit, follow, shadowed);
+        }
+    }
+}
 
-            // Computing per-light factors of Phong model components
-            // (diffuse and specular).
-            Color diffuse, specular, reflection;
-            for(unsigned int i = 0; i < lights.size(); i++)
-            {   
-                // Light direction vector (from the hit point to the light)
-                Vector L = (lights[i]->position - hit).normalized();
+template <int features, class Follow, class Shadowed>
+Color Scene::shadePhong(const Ray &ray, Object *obj, const Hit &min_hit, Follow follow, Shadowed shadowed)
+{
+    Material *material = obj->material;            //the hit objects material
+    Point hit = ray.at(min_hit.t);                 //the hit point
+    Vector N = min_hit.N;                          //the normal at hit point
+    Vector V = -ray.D;                             //the view vector
+    double footprint = ray.footprint(min_hit.t);   //the width of the ray there
+    Color surfaceColor = (features & KERNEL_TEXTURES)  //the colour there
+        ? obj->colorAt(hit, footprint) : material->color;
+
+    // Computing of the color using the Phong reflection model:
+    // https://en.wikipedia.org/wiki/Phong_reflection_model
+
+    // Computing per-light factors of Phong model components
+    // (diffuse and specular).
+    Color diffuse, specular;
+    for(unsigned int i = 0; i < lights.size(); i++)
+    {   
+        // Light direction vector (from the hit point to the light)
+        Vector L = (lights[i]->position - hit).normalized();
+
+        if(!(features & KERNEL_SHADOWS) || !shadowed(i, hit))
+        {
+            // Diffuse per-light component: L.N
+            // Maximized when the light direction (L) is aligned with
+            // the normal vector of the surface (N).
+            double angle = L.dot(N);
+            if(angle > 0)
+                diffuse += angle * lights[i]->color;
+
+            // Specular per-light component: R.V^n
+            // Maximized when the viewer direction (V) is aligned with
+            // the light reflected on the surface (R).
+            // R is computed using the formula R = 2 * L.N * N - L.
+            // Reusing old angle variable calculated above as L.N.
+            angle = (2 * angle * N - L).normalized().dot(V);
+            if(angle > 0)
+                specular += pow(angle, material->n) * lights[i]->color;
+        }
+    }
+
+    // The ambient component is added, and both the ambient and diffuse
+    // components are affected by the material color.
+    Color color = material->opacity * ((material->ka + diffuse * material->kd) * surfaceColor)
+        + specular * material->ks;
 
-                if(!enableShadows || !checkShadow(obj, hit, min_hit, L))
+	// Reflections
+	Vector n = N.normalized();
+	Vector refl = ray.D -  2 * (ray.D.dot(n)) * n;
+
+	Ray reflRay = Ray(hit, refl, obj, ray.eta);
+	reflRay.copyMedia(ray);
+	reflRay.originFace = min_hit.face;
+	// Surfaces are taken as flat: the cone keeps growing as it did
+	reflRay.coneWidth = footprint;
+	reflRay.coneSpread = ray.coneSpread;
+
+	// Refraction/transparency: the direction is found first, as on total
+	// internal reflection the refracted light is the reflected one
+	bool transparent = (features & KERNEL_REFRACTION) && material->opacity < 1.0;
+	bool refracted = false;
+	Ray refrRay = Ray(hit, Vector(), obj);
+	if (transparent)
+	{
+		// The ray knows which medium it is in
+		double etaFrom = ray.eta, etaOut;
+		refrRay.copyMedia(ray);
+
+		// N can be pointing towards or away from us,
+		// could be used for determining whether we are entering or exiting
+		// but only for convex objects
+		if (N.dot(ray.D) >=0) // hitting from inside
+		{
+			// we are getting out, yes, but are we still inside some other object ?
+			refrRay.leave(obj);
+			etaOut = refrRay.medium() ? refrRay.medium()->material->eta : 1.0;
+			refracted = getRefracted(ray.D, -N.normalized(), etaFrom, etaOut, refrRay.D);
+		}
+		else // hitting from outside
+		{
+			refrRay.enter(obj);
+			etaOut = material->eta;
+			refracted = getRefracted(ray.D, N.normalized(), etaFrom, etaOut, refrRay.D);
+		}
+		refrRay.eta = etaOut;
+		refrRay.originFace = min_hit.face;
+		refrRay.coneWidth = footprint;
+		refrRay.coneSpread = ray.coneSpread;
+	}
+
+	double scale = spawn(ray, material->ks, reflRay);
+	bool isReflected = scale > 0;
+	if (isReflected)
+	{
+		// On total internal reflection, the reflected colour also counts
+		// as the refracted one
+		double factor = scale * material->ks;
+		if (transparent && !refracted)
+			factor += 1-material->opacity;
+		RenderStats::countRay(RenderCounters::reflectionRays);
+		color += follow(reflRay, factor);
+	}
+
+	if (transparent)
+	{
+		if (refracted)
+		{
+			if ((scale = spawn(ray, 1-material->opacity, refrRay)) > 0)
+			{
+				RenderStats::countRay(RenderCounters::refractionRays);
+				color += follow(refrRay, scale * (1-material->opacity));
+			}
+		}
+		else if (!isReflected) // total internal reflection: all the light is reflected
+		{
+			if ((scale = spawn(ray, 1-material->opacity, reflRay)) > 0)
+			{
+				RenderStats::countRay(RenderCounters::reflectionRays);
+				color += follow(reflRay, scale * (1-material->opacity));
+			}
+		}
+	}
+
+    return color;
+}
+
+template <Scene::RenderMode mode>
+Scene::ShadeKernel Scene::kernelFor(int features)
+{
+    static const ShadeKernel kernels[8] = {
+        &Scene::shadeKernel<mode, 0>, &Scene::shadeKernel<mode, 1>,
+        &Scene::shadeKernel<mode, 2>, &Scene::shadeKernel<mode, 3>,
+        &Scene::shadeKernel<mode, 4>, &Scene::shadeKernel<mode, 5>,
+        &Scene::shadeKernel<mode, 6>, &Scene::shadeKernel<mode, 7>
+    };
+    return kernels[features];
+}
+
+void Scene::selectKernel()
+{
+    // Features used by at least one object
+    bool refraction = false, textures = false;
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        const Material* material = objects[i]->material;
+        refraction = refraction || material->opacity < 1.0;
+        textures = textures || material->texture;
+    }
+    int features = (enableShadows && !lights.empty() ? KERNEL_SHADOWS : 0)
+        | (refraction ? KERNEL_REFRACTION : 0)
+        | (textures ? KERNEL_TEXTURES : 0);
+
+    static const WavefrontKernel wavefronts[8] = {
+        &Scene::traceWavefront<0>, &Scene::traceWavefront<1>,
+        &Scene::traceWavefront<2>, &Scene::traceWavefront<3>,
+        &Scene::traceWavefront<4>, &Scene::traceWavefront<5>,
+        &Scene::traceWavefront<6>, &Scene::traceWavefront<7>
+    };
+    wavefrontKernel = wavefronts[features];
+
+    switch(renderMode)
+    {
+        case zbuffer: kernel = &Scene::shadeKernel<zbuffer, 0>; break;
+        case normal: kernel = &Scene::shadeKernel<normal, 0>; break;
+        case gooch: kernel = kernelFor<gooch>(features); break;
+        default: // phong, and cost which measures it
+            kernel = kernelFor<phong>(features); break;
+    }
+}
+
+/**
+ * Breadth-first tracing: all the rays of a bounce are intersected and shaded
+ * before those of the next one, so that the secondary rays can be sorted and
+ * rays going the same way from close points traced one after the other. The
+ * colours are those of the recursive phong kernel, up to rounding; only the
+ * order in which Russian roulette and ray budgets draw differs (shallow
+ * bounces first). Rays are intersected by batches of RayPacket::MAX_SIZE,
+ * whose shadow rays are traced together before any of them is shaded.
+ */
+template <int features>
+void Scene::traceWavefront(Wavefront &stream, Color *colors, double *depths)
+{
+    Hit noHit(std::numeric_limits<double>::infinity(), Vector());
+    std::vector<Hit> hits(RayPacket::MAX_SIZE, noHit);
+    Object* objs[RayPacket::MAX_SIZE];
+    std::vector<QueuedRay> &queue = stream.queue, &next = stream.next;
+    std::vector<unsigned int> &order = stream.order, &sorted = stream.sorted;
+    std::vector<unsigned short> &keys = stream.keys;
+    std::vector<char> &shadowed = stream.shadowed;
+
+    for (int depth = 0; depth <= maxRecursionDepth && !queue.empty(); depth++)
+    {
+        // Primary rays come in the order of their pixels, which is coherent
+        // already. Secondary rays start from everywhere in every direction:
+        // they are sorted by the octant of their direction, then along a
+        // Morton curve over their origins (16 cells a side), so that
+        // neighbours in the queue go the same way from close points. The
+        // sort is stable: rays of a cell keep the order of their pixels.
+        unsigned int count = queue.size();
+        order.resize(count);
+        for (unsigned int i = 0; i < count; i++)
+            order[i] = i;
+        if (depth > 0)
+        {
+            AABB origins;
+            for (unsigned int i = 0; i < count; i++)
+                origins.extend(queue[i].ray.O);
+            MortonCurve curve(origins);
+            keys.resize(count);
+            for (unsigned int i = 0; i < count; i++)
+            {
+                const Ray &ray = queue[i].ray;
+                int octant = (ray.D.x < 0) | (ray.D.y < 0) << 1 | (ray.D.z < 0) << 2;
+                keys[i] = octant << 12 | curve.code(ray.O) >> 18;
+            }
+
+            // Counting sort, one byte of the 15 bit keys at a time
+            sorted.resize(count);
+            for (int shift = 0; shift < 16; shift += 8)
+            {
+                unsigned int offsets[257] = {0};
+                for (unsigned int i = 0; i < count; i++)
+                    offsets[((keys[order[i]] >> shift) & 255) + 1]++;
+                for (int digit = 0; digit < 256; digit++)
+                    offsets[digit + 1] += offsets[digit];
+                for (unsigned int i = 0; i < count; i++)
+                    sorted[offsets[(keys[order[i]] >> shift) & 255]++] = order[i];
+                order.swap(sorted);
+            }
+        }
+        auto entryAt = [&](unsigned int i) -> QueuedRay& { return queue[order[i]]; };
+
+        next.clear();
+        for (unsigned int begin = 0; begin < count; begin += RayPacket::MAX_SIZE)
+        {
+            RayPacket packet;
+            for (unsigned int i = begin; i < count && packet.size < RayPacket::MAX_SIZE; i++)
+            {
+                hits[packet.size] = noHit;
+                packet.add(&entryAt(i).ray);
+            }
+
+            // Secondary rays are traced one by one: even sorted, those of a
+            // packet start too far apart for the packet to cull nodes as
+            // well as single rays do
+            if (usePackets && depth == 0)
+                intersectPacket(packet, &hits[0], objs);
+            else
+                for (int k = 0; k < packet.size; k++)
+                    objs[k] = intersect(*packet.rays[k], hits[k]);
+
+            // The shadow rays of the batch, light by light: neighbours in
+            // the batch are mostly hidden by the same object, so the object
+            // hiding the previous ray is tried first, before searching the
+            // scene
+            if (features & KERNEL_SHADOWS)
+            {
+                shadowed.assign(lights.size() * packet.size, 0);
+                for (unsigned int i = 0; i < lights.size(); i++)
                 {
-                    // Diffuse per-light component: L.N
-                    // Maximized when the light direction (L) is aligned with
-                    // the normal vector of the surface (N).
-                    double angle = L.dot(N);
-                    if(angle > 0)
-                        diffuse += angle * lights[i]->color;
+                    Object* blocker = NULL;
+                    for (int k = 0; k < packet.size; k++)
+                    {
+                        if (!objs[k])
+                            continue;
+                        Point hit = packet.rays[k]->at(hits[k].t);
+                        Vector toLight = lights[i]->position - hit;
+                        double distance = toLight.length();
+                        Ray shadowRay(hit, toLight / distance, objs[k]);
+                        shadowRay.originFace = hits[k].face;
+                        RenderStats::countRay(RenderCounters::shadowRays);
+                        bool hidden = (blocker && !startsFrom(shadowRay, blocker) && blocker->occludes(shadowRay, distance))
+                            || occluded(shadowRay, distance, &blocker);
+                        if (!hidden)
+                            blocker = NULL;
+                        shadowed[i * packet.size + k] = hidden;
+                    }
+                }
+            }
 
-                    // Specular per-light component: R.V^n
-                    // Maximized when the viewer direction (V) is aligned with
-                    // the light reflected on the surface (R).
-                    // R is computed using the formula R = 2 * L.N * N - L.
-                    // Reusing old angle variable calculated above as L.N.
-                    angle = (2 * angle * N - L).normalized().dot(V);
-                    if(angle > 0)
-                        specular += pow(angle, material->n) * lights[i]->color;
+            for (int k = 0; k < packet.size; k++)
+            {
+                const QueuedRay &entry = entryAt(begin + k);
+                if (depths && depth == 0)
+                    depths[entry.pixel] = objs[k] ? hits[k].t : -1;
+                if (!objs[k])
+                    continue;
+
+                // Secondary rays wait for the next bounce, if there is one
+                auto follow = [&](const Ray &child, double factor)
+                {
+                    if (depth < maxRecursionDepth)
+                        next.emplace_back(child, entry.factor * factor, entry.pixel);
+                    return Color(0.0, 0.0, 0.0);
+                };
+                auto isShadowed = [&](unsigned int i, const Point &)
+                {
+                    return shadowed[i * packet.size + k] != 0;
+                };
+                colors[entry.pixel] += entry.factor * shadePhong<features>(entry.ray, objs[k], hits[k], follow, isShadowed);
+            }
+        }
+        queue.swap(next);
+    }
+    queue.clear();
+}
+
+/**
+ * Finds the closest object hit by the ray (ignoring ray.origin), and stores
+ * the hit in min_hit. Returns NULL if nothing is hit closer than min_hit.t.
+ */
+Object* Scene::intersect(const Ray &ray, Hit &min_hit)
+{
+    Object *obj = NULL;
+
+    // Brute force, used when the accelerator is disabled or not built yet
+    if (!useAccelerator || bvh.isEmpty())
+    {
+        for (unsigned int i = 0; i < objects.size(); ++i) {
+            if(!startsFrom(ray, objects[i]))
+            {
+                Hit hit(objects[i]->intersect(ray));
+                if (hit.t<min_hit.t) {
+                    min_hit = hit;
+                    obj = objects[i];
                 }
             }
+        }
+        return obj;
+    }
 
-            // Reflections
-			Vector n = N.normalized();
-			Vector refl = ray.D -  2 * (ray.D.dot(n)) * n;
-
-			Ray reflRay = Ray(hit, refl, obj);
-			reflection = trace(reflRay, recursionDepth+1);
-			
-			
-			// Refraction/transparency
-			Color refraction = Color(0,0,0); ;
-			if (material->opacity < 1.0)
-			{
-				try
-				{
-					double etaFrom = 1, etaOut=1;
-					// where are we coming from ?
-					if (ray.parent != NULL)
-						etaFrom = ray.parent->eta;
-					
-					
-					// N can be pointing towards or away from us,
-					// could be used for determining whether we are entering or exiting
-					// but only for convex objects
-					Vector refr;
-					if (N.dot(ray.D) >=0) // hitting from inside
-					{
-						// we are getting out, yes, but are we still inside some other object ?
-						// the last one defined overwrites the rest
-						Object* container = getObjectsContaining(hit, obj).back();
-						if (container != NULL) 
-							etaOut = container->material->eta;
-						refr = getRefracted(ray.D, N.normalized(), etaFrom, etaOut);
-					}
-					else // hitting from outside
-					{
-						etaOut = material->eta;
-						refr = getRefracted(-ray.D, N.normalized(), etaFrom, etaOut);
-					}
-					
-					Ray refrRay = Ray(hit, refr, obj, &ray, etaOut);
-					refraction = trace(refrRay, recursionDepth+1);
-				}
-				catch (...)
-				{ }
-			}
-			
-
-            // Returning all components together with their coefficients applied.
-            // The ambient component is added, and both the ambient and diffuse
-            // components are affected by the material color.
-            return
-            material->opacity * ((material->ka + diffuse * material->kd) * obj->colorAt(hit))
-            + (1-material->opacity) * refraction
-            + (specular + reflection) * material->ks;
+    for (unsigned int i = 0; i < unbounded.size(); ++i) {
+        if(!startsFrom(ray, unbounded[i]))
+        {
+            Hit hit(unbounded[i]->intersect(ray));
+            if (hit.t<min_hit.t) {
+                min_hit = hit;
+                obj = unbounded[i];
+            }
         }
     }
+
+    auto closest = [&](unsigned int i, double& tMax)
+    {
+        if (!startsFrom(ray, bounded[i]))
+        {
+            Hit hit(bounded[i]->intersect(ray));
+            if (hit.t<min_hit.t) {
+                min_hit = hit;
+                obj = bounded[i];
+                tMax = hit.t;
+            }
+        }
+        return false;
+    };
+    bvh.traverse(ray, min_hit.t, closest);
+
+    return obj;
 }
 
-// Checks if an object is blocking the light to obj.
-bool Scene::checkShadow(const Object* obj, const Point& hit, const Hit& min_hit, const Vector& L)
+/**
+ * Closest hit for every ray of the packet, which must all be primary rays
+ * (not starting from an object). hits[i] must be set to a hit at infinity,
+ * and is replaced along with objs[i] (left NULL if nothing is hit).
+ * The rays go through the BVH together, and are traced one by one if they
+ * don't all go in the same direction.
+ */
+void Scene::intersectPacket(const RayPacket &packet, Hit *hits, Object **objs)
 {
-    for (unsigned int i = 0; i < objects.size(); i++)
+    if (!useAccelerator || bvh.isEmpty() || !packet.isCoherent())
+    {
+        for (int i = 0; i < packet.size; i++)
+            objs[i] = intersect(*packet.rays[i], hits[i]);
+        return;
+    }
+
+    double tMax[RayPacket::MAX_SIZE];
+    for (int i = 0; i < packet.size; i++)
     {
-        if(objects[i] != obj)
+        objs[i] = NULL;
+        for (unsigned int j = 0; j < unbounded.size(); ++j) {
+            Hit hit(unbounded[j]->intersect(*packet.rays[i]));
+            if (hit.t<hits[i].t) {
+                hits[i] = hit;
+                objs[i] = unbounded[j];
+            }
+        }
+        tMax[i] = hits[i].t;
+    }
+
+    auto closest = [&](unsigned int start, unsigned int count, int first, double* tMax)
+    {
+        for (unsigned int j = start; j < start + count; j++)
         {
-            Hit cover(objects[i]->intersect(Ray(hit, L)));
-            if (cover.t != std::numeric_limits<double>::infinity()
-                && cover.t < min_hit.t)
+            Object* obj = bounded[bvh.indices[j]];
+            unsigned int closer = obj->intersectPacket(packet, first, hits);
+            for (int i = first; i < packet.size; i++)
+                if ((closer >> i) & 1)
+                {
+                    objs[i] = obj;
+                    tMax[i] = hits[i].t;
+                }
+        }
+    };
+    bvh.traversePacket(packet, tMax, closest);
+}
+
+/**
+ * Any-hit query: returns true as soon as an object (other than ray.origin)
+ * is hit strictly between the ray's origin and maxDistance. Unlike
+ * intersect(), the first blocker found ends the search, closest or not.
+ * That object is stored in *blocker, if given.
+ */
+bool Scene::occluded(const Ray &ray, double maxDistance, Object **blocker)
+{
+    if (!useAccelerator || bvh.isEmpty())
+    {
+        for (unsigned int i = 0; i < objects.size(); i++)
+        {
+            if(!startsFrom(ray, objects[i]))
+            {
+                if (objects[i]->occludes(ray, maxDistance))
+                {
+                    if (blocker)
+                        *blocker = objects[i];
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    for (unsigned int i = 0; i < unbounded.size(); i++)
+    {
+        if(!startsFrom(ray, unbounded[i]))
+        {
+            if (unbounded[i]->occludes(ray, maxDistance))
+            {
+                if (blocker)
+                    *blocker = unbounded[i];
                 return true;
+            }
         }
     }
-    return false;
+
+    bool blocked = false;
+    auto anyHit = [&](unsigned int i, double&)
+    {
+        if (!startsFrom(ray, bounded[i]))
+        {
+            if (bounded[i]->occludes(ray, maxDistance))
+            {
+                if (blocker)
+                    *blocker = bounded[i];
+                blocked = true;
+            }
+        }
+        return blocked;
+    };
+    bvh.traverse(ray, maxDistance, anyHit);
+    return blocked;
 }
 
+// Checks if an object is blocking the light to obj: only objects between the
+// hit point and the light itself cast a shadow.
+bool Scene::checkShadow(Object* obj, int face, const Point& hit, const Point& lightPosition)
+{
+    Vector toLight = lightPosition - hit;
+    double distance = toLight.length();
+    Ray shadowRay(hit, toLight / distance, obj);
+    shadowRay.originFace = face;
+    RenderStats::countRay(RenderCounters::shadowRays);
+    return occluded(shadowRay, distance);
+}
+
+// Samples taken so far for a pixel, with adaptive sampling: the colours are
+// added up for the average, and clamped to [0, 1] for the variance (so that
+// very bright highlights do not refine their whole surroundings)
+struct PixelSamples
+{
+    Color sum, clampedSum, clampedSquares;
+    int count;
+
+    PixelSamples() : count(0) { }
+
+    void add(const Color &sample)
+    {
+        Color clamped = sample;
+        clamped.clamp();
+        sum += sample;
+        clampedSum += clamped;
+        clampedSquares += clamped * clamped;
+        count++;
+    }
+
+    Color mean() const { return sum / count; }
+
+    // Largest standard deviation of the three components
+    double deviation() const
+    {
+        Color variance = (clampedSquares - clampedSum * clampedSum / count) / (count - 1);
+        return sqrt(std::max(0.0, std::max(variance.r, std::max(variance.g, variance.b))));
+    }
+};
+
 /**
  * superSamplingMult : size of grid of points for each pixel
  * ex : 2 -> 2*2 = 4 samples per pixel
@@ -227,8 +693,9 @@ bool Scene::checkShadow(const Object* obj, const Point& hit, const Hit& min_hit,
  */
 void Scene::render(Image &img)
 {
-	double s = 1.0/(superSamplingMult+1);
-	
+    RenderStats::Timer traceTimer(stats, RenderStats::trace);
+    selectKernel();
+
     int w = img.width();
     int h = img.height();
 
@@ -246,96 +713,374 @@ void Scene::render(Image &img)
     // Center of the screen in 3D space
     Point center = (lookAt-eye).normalized() * focalDistance + eye;
 
-    int progression = 0;
+    // With adaptive sampling, the image is rendered twice: once with the
+    // SuperSampling grid (at least 2x2, to estimate the variance of every
+    // pixel), then with the maxSuperSampling grid as well for the pixels
+    // whose samples vary too much. All the samples of a pixel are averaged.
+    int firstGrid = adaptiveThreshold > 0 ? std::max(superSamplingMult, 2) : superSamplingMult;
+    bool adaptive = adaptiveThreshold > 0 && maxSuperSamplingMult > firstGrid;
+    if (!adaptive)
+        firstGrid = superSamplingMult;
+    std::vector<PixelSamples> samples(adaptive ? w*h : 0);
+
+    // Shared by all threads: the number of pixels done in the current pass
+    // is counted atomically, and printing is serialized by a lock.
+    std::atomic<int> progression(0);
     float progressionRatio = 100.0f / (float)(w*h);
-    float nextPercent = printProgression;
-    
+    std::atomic<float> nextPercent(printProgression);
+    std::mutex printLock;
 	
 	// plugging this in to get the true distance to camera
 	// in most cases we'd be using the z-buffer, but here there's no point
-	double depthHere ; std::vector<std::vector<double>> depth;
+	std::vector<std::vector<double>> depth;
 	if (enableDepthOfField)
 		 depth = vector<vector<double>>(h, vector<double>(w));
 	
-	//#pragma omp parallel for
-    for (int y = 0; y < h; y++)
+    // Ray through sample (sx, sy) of the n*n grid of pixel (x, y)
+    auto primaryRay = [&](int x, int y, int sx, int sy, int n)
+    {
+        double s = 1.0/(n+1);
+        Point pixel = right * (w / 2 - (x+s+sx*s))
+            + up * (h / 2 - (y+s+sy*s))
+            + center;
+        Ray ray(eye, (pixel-eye).normalized());
+        // Samples are 1/n unit apart on the screen, focalDistance away
+        ray.coneSpread = 1.0 / (n * focalDistance);
+        RenderStats::countRay(RenderCounters::primaryRays);
+        return ray;
+    };
+
+    // The cost mode renders the Phong image, measuring the work done for
+    // every pixel, then shows that instead
+    bool costMode = renderMode == cost;
+    std::vector<double> pixelCost(costMode ? w*h : 0);
+
+    // Work done so far by the calling thread, in the unit of costMeasure
+    auto workDone = [&]()
+    {
+        if (costMeasure == costTime)
+            return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        const RenderCounters* counters = RenderStats::getLocal();
+        if (costMeasure == costNodes)
+            return (double)counters->nodes;
+        long long tests = 0;
+        for (int i = 0; i < RenderCounters::numPrimitiveTypes; i++)
+            tests += counters->tests[i];
+        return (double)tests;
+    };
+
+    // Secondary rays of a pixel rendered with n*n samples. The random numbers
+    // depend on the pixel and the pass only.
+    auto pixelBudget = [&](int x, int y, int n)
+    {
+        return PathBudget(rayBudget > 0 ? rayBudget : -1, (unsigned int)(y*w + x) * 32 + n);
+    };
+
+    // Every sample of pixel (x, y) goes through addSample, and setPixel
+    // stores its colour once the n*n samples adding up to col are taken
+    auto addSample = [&](int x, int y, const Color &col)
     {
-        for (int x = 0; x < w; x++)
+        if (adaptive)
+            samples[y*w + x].add(col);
+    };
+    auto setPixel = [&](int x, int y, const Color &col, int n)
+    {
+        img(x,y) = adaptive ? samples[y*w + x].mean() : col / (n*n);
+    };
+
+    // The cost mode measures the recursive integrator, pixel by pixel
+    bool useWavefront = integrator == wavefront && renderMode == phong;
+    std::vector<Wavefront> streams; // one per thread
+
+    // Renders the pixels of the tile with n*n samples each, on the given
+    // thread. If selected is given, only the pixels for which it is set are
+    // rendered.
+    auto renderTile = [&](const TileScheduler::Tile& tile, int thread, int n, const std::vector<char>* selected)
+    {
+        double depthHere;
+        int rendered = 0;
+        if (useWavefront)
         {
-			Color col = Color(0.0,0.0,0.0);
-			for (int sx = 0 ; sx < superSamplingMult ; sx++)
-			{
-				for (int sy = 0 ; sy < superSamplingMult ; sy++)
-				{
-                    Point pixel = right * (w / 2 - (x+s+sx*s))
-                        + up * (h / 2 - (y+s+sy*s))
-                        + center;
-
-                    Ray ray(eye, (pixel-eye).normalized());
-                    
-                    
-					Color colbuf = trace(ray, 0, &depthHere);
-					col += (colbuf);
-					
-					if (enableDepthOfField)
-						depth[y][x] = depthHere;
-				}
-			}
-			col = col / (superSamplingMult*superSamplingMult);
-			//col.clamp();
-            img(x,y) = col;
+            // All the samples of the tile make one stream (small enough for
+            // its queues to stay in cache), queued by blocks of 4x4 pixels
+            // for each sample position, as packets are. With adaptive
+            // sampling, every sample has its own slot in cols.
+            int tileWidth = tile.x1 - tile.x0;
+            int numPixels = tileWidth * (tile.y1 - tile.y0);
+            int slots = adaptive ? n*n : 1;
+            std::vector<Color> cols(numPixels * slots, Color(0.0,0.0,0.0));
+            std::vector<double> depths(enableDepthOfField ? numPixels * slots : 0);
+            std::vector<PathBudget> budgets;
+            budgets.reserve(numPixels);
+            for (int y = tile.y0; y < tile.y1; y++)
+                for (int x = tile.x0; x < tile.x1; x++)
+                    budgets.push_back(pixelBudget(x, y, n));
+
+            std::vector<QueuedRay> &queue = streams[thread].queue;
+            for (int by = tile.y0; by < tile.y1; by += 4)
+                for (int bx = tile.x0; bx < tile.x1; bx += 4)
+                    for (int sx = 0 ; sx < n ; sx++)
+                        for (int sy = 0 ; sy < n ; sy++)
+                            for (int y = by; y < std::min(by + 4, tile.y1); y++)
+                                for (int x = bx; x < std::min(bx + 4, tile.x1); x++)
+                                {
+                                    if (selected && !(*selected)[y*w + x])
+                                        continue;
+                                    int pixel = (y - tile.y0) * tileWidth + x - tile.x0;
+                                    int slot = pixel * slots + (adaptive ? sx*n + sy : 0);
+                                    queue.emplace_back(primaryRay(x, y, sx, sy, n), 1.0, slot);
+                                    queue.back().ray.budget = &budgets[pixel];
+                                }
+
+            (this->*wavefrontKernel)(streams[thread], &cols[0], enableDepthOfField ? &depths[0] : NULL);
+
+            for (int y = tile.y0; y < tile.y1; y++)
+                for (int x = tile.x0; x < tile.x1; x++)
+                {
+                    if (selected && !(*selected)[y*w + x])
+                        continue;
+                    int pixel = (y - tile.y0) * tileWidth + x - tile.x0;
+                    Color col(0.0,0.0,0.0);
+                    for (int slot = pixel * slots; slot < (pixel + 1) * slots; slot++)
+                    {
+                        addSample(x, y, cols[slot]);
+                        col += cols[slot];
+                    }
+                    setPixel(x, y, col, n);
+                    if (enableDepthOfField)
+                        depth[y][x] = depths[(pixel + 1) * slots - 1];
+                    rendered++;
+                }
+        }
+        // Packets share the work of their pixels: it is measured pixel by
+        // pixel without them
+        else if (!usePackets || costMode)
+        {
+            for (int y = tile.y0; y < tile.y1; y++)
+            {
+                for (int x = tile.x0; x < tile.x1; x++)
+                {
+                    if (selected && !(*selected)[y*w + x])
+                        continue;
+
+                    double workBefore = costMode ? workDone() : 0;
+                    Color col = Color(0.0,0.0,0.0);
+                    PathBudget budget = pixelBudget(x, y, n);
+                    for (int sx = 0 ; sx < n ; sx++)
+                    {
+                        for (int sy = 0 ; sy < n ; sy++)
+                        {
+                            Ray ray = primaryRay(x, y, sx, sy, n);
+                            ray.budget = &budget;
+                            Color colbuf = trace(ray, 0, &depthHere);
+                            col += (colbuf);
+                            addSample(x, y, colbuf);
+
+                            if (enableDepthOfField)
+                                depth[y][x] = depthHere;
+                        }
+                    }
+                    //col.clamp();
+                    setPixel(x, y, col, n);
+                    rendered++;
+
+                    if (costMode)
+                        pixelCost[y*w + x] += workDone() - workBefore;
+                }
+            }
+        }
+        else
+        {
+            // Blocks of 4x4 pixels: for each sample position, the primary
+            // rays of the block are intersected together, then shaded one by
+            // one.
+            std::vector<Ray> rays;
+            rays.reserve(RayPacket::MAX_SIZE);
+            Hit noHit(std::numeric_limits<double>::infinity(), Vector());
+            std::vector<Hit> hits(RayPacket::MAX_SIZE, noHit);
+            Object* objs[RayPacket::MAX_SIZE];
+            Color cols[RayPacket::MAX_SIZE];
+            int px[RayPacket::MAX_SIZE], py[RayPacket::MAX_SIZE];
+            std::vector<PathBudget> budgets;
 
-            progression += 1;
-            if(printProgression > 0.0f
-                && progression * progressionRatio >= nextPercent)
+            for (int by = tile.y0; by < tile.y1; by += 4)
             {
-                //#pragma omp critical
+                for (int bx = tile.x0; bx < tile.x1; bx += 4)
                 {
-                    // Critical : block other threads from writing at the same time.
-                    // We cannot tell only the first thread to print as it can finish its job before all other threads
-                    // and stop printing at something like 80% progression.
-                    std::cout << "Rendering: " << std::fixed << std::setprecision(1) << nextPercent << "%" << std::endl;
-                    nextPercent += printProgression;
+                    int count = 0;
+                    budgets.clear();
+                    for (int y = by; y < std::min(by + 4, tile.y1); y++)
+                        for (int x = bx; x < std::min(bx + 4, tile.x1); x++)
+                            if (!selected || (*selected)[y*w + x])
+                            {
+                                px[count] = x;
+                                py[count] = y;
+                                cols[count] = Color(0.0,0.0,0.0);
+                                budgets.push_back(pixelBudget(x, y, n));
+                                count++;
+                            }
+                    if (count == 0)
+                        continue;
+
+                    for (int sx = 0 ; sx < n ; sx++)
+                    {
+                        for (int sy = 0 ; sy < n ; sy++)
+                        {
+                            rays.clear();
+                            RayPacket packet;
+                            for (int k = 0; k < count; k++)
+                            {
+                                rays.push_back(primaryRay(px[k], py[k], sx, sy, n));
+                                rays[k].budget = &budgets[k];
+                                packet.add(&rays[k]);
+                                hits[k] = noHit;
+                            }
+                            intersectPacket(packet, &hits[0], objs);
+
+                            for (int k = 0; k < count; k++)
+                            {
+                                Color col = shade(rays[k], objs[k], hits[k], 0, &depthHere);
+                                cols[k] += col;
+                                addSample(px[k], py[k], col);
+                                if (enableDepthOfField)
+                                    depth[py[k]][px[k]] = depthHere;
+                            }
+                        }
+                    }
+
+                    for (int k = 0; k < count; k++)
+                        setPixel(px[k], py[k], cols[k], n);
+                    rendered += count;
                 }
             }
         }
+
+        int done = progression += rendered;
+        if(printProgression > 0.0f && done * progressionRatio >= nextPercent)
+        {
+            // Block other threads from writing at the same time. Whichever
+            // thread crosses a step prints it, so that we get to 100% even if
+            // some threads finish early.
+            std::lock_guard<std::mutex> guard(printLock);
+            while (done * progressionRatio >= nextPercent)
+            {
+                std::ostringstream line;
+                line << "Rendering: " << std::fixed << std::setprecision(1) << nextPercent << "%";
+                std::cout << line.str() << std::endl;
+                nextPercent = nextPercent + printProgression;
+            }
+        }
+    };
+
+    TileScheduler scheduler(w, h);
+    int threads = numThreads > 0 ? numThreads : TileScheduler::defaultThreads();
+    streams.resize(useWavefront ? threads : 0);
+
+    // With stats (or to measure costs), every thread counts into its own
+    // counters, which are added up once the image is traced
+    std::vector<RenderCounters> threadCounters(stats || costMode ? threads : 0);
+    auto countOn = [&](int thread)
+    {
+        if (!threadCounters.empty())
+            RenderStats::setLocal(&threadCounters[thread]);
+    };
+
+    scheduler.run(threads, [&](const TileScheduler::Tile& tile, int thread)
+    {
+        countOn(thread);
+        renderTile(tile, thread, firstGrid, 0);
+    });
+    numPrimaryRays = (long long)w * h * firstGrid * firstGrid;
+
+    if (adaptive)
+    {
+        // A pixel is refined when the standard deviation of one of the
+        // colour components of its samples is above the threshold
+        std::vector<char> selected(w*h, 0);
+        int numSelected = 0;
+        for (int i = 0; i < w*h; i++)
+            if (samples[i].deviation() > adaptiveThreshold)
+            {
+                selected[i] = 1;
+                numSelected++;
+            }
+
+        if (printProgression > 0.0f)
+            std::cout << "Adaptive sampling: refining " << numSelected << " of " << w*h << " pixels" << std::endl;
+
+        progression = 0;
+        progressionRatio = 100.0f / (float)std::max(numSelected, 1);
+        nextPercent = printProgression;
+        scheduler.run(threads, [&](const TileScheduler::Tile& tile, int thread)
+        {
+            countOn(thread);
+            renderTile(tile, thread, maxSuperSamplingMult, &selected);
+        });
+        numPrimaryRays += (long long)numSelected * maxSuperSamplingMult * maxSuperSamplingMult;
+    }
+
+    RenderStats::setLocal(NULL);
+    if (stats)
+    {
+        for (unsigned int i = 0; i < threadCounters.size(); i++)
+            stats->counters.add(threadCounters[i]);
+        stats->threads = threads;
+    }
+    traceTimer.stop();
+
+    if (costMode)
+    {
+        static const char* units[] = { "intersection tests", "BVH nodes", "ns" };
+        double lowest, highest;
+        drawCostMap(img, pixelCost, costLogScale, costLegend, lowest, highest);
+        std::cout << "Cost map: from " << lowest << " (black) to " << highest << " "
+            << units[costMeasure] << " per pixel (white)"
+            << (costLogScale ? ", log scale" : "") << std::endl;
+        return;
     }
     
     
     if (enableDepthOfField)
     {
-		// sprite scattering method
-		Image* flares = new Image(img.width(), img.height());
-		flares->fill(Color(0,0,0));
+		RenderStats::Timer dofTimer(stats, RenderStats::depthOfField);
+
+		// calculating blur disk diameter
+		// en.wikipedia.org/wiki/Depth_of_field#Foreground_and_background_blur_2
+		// b = (f*m/N)*((D-s)/D)
+		// Pixels where nothing was hit are infinitely far: b = f*m/N.
+		double magnification = focalLength / (focusDistance - focalLength );
+		double fNumber = focalLength/apertureDiameter;
+		std::vector<float> coc(w*h);
+		std::vector<char> nearField(w*h);
 		for (int y = 0; y < h; y++)
 		{
 			for (int x = 0; x < w; x++)
 			{
+				double blurDiskDiameter = focalLength*magnification/fNumber;
 				if (depth[y][x] > 0)
-				{
-					// calculating blur disk diameter
-					// en.wikipedia.org/wiki/Depth_of_field#Foreground_and_background_blur_2
-					
-					// b = (f*m/N)*((D-s)/D)
-					double magnification = focalLength / (focusDistance - focalLength );
-					double fNumber = focalLength/apertureDiameter;
-					double blurDiskDiameter = (focalLength*magnification/fNumber) * ((depth[y][x] - focusDistance)/depth[y][x]) ;
-					
-					//blur is the sum of all these circles (which we draw over "flares")
-					// in theory the areas in focus will get circles equal or beneath one pixel
-					
-					//std::cout << x << " "<< y << " | " << blurDiskDiameter << " | " << (int)(blurDiskDiameter*1000) << std::endl ;
-					flares->addCircle(x, y, img.get_pixel(x,y), (int)(blurDiskDiameter*1000));
-					
-				}
+					blurDiskDiameter *= (depth[y][x] - focusDistance)/depth[y][x];
+
+				// radius in pixels, at the scale the scene files are made for
+				coc[y*w + x] = fabs(blurDiskDiameter*1000);
+				nearField[y*w + x] = blurDiskDiameter < 0;
 			}
 		}
-		
-		// add that to the image
-		img.overlay(*flares, 0.01, false);
+
+		depthOfField(img, coc, nearField, threads);
 	}
 	
-	img.smartClamp();
+	// Colours are brought into [0, 1] in one pass
+	RenderStats::Timer toneMapTimer(stats, RenderStats::toneMap);
+	PostProcess post;
+	if (exposure != 0)
+		post.addExposure(exposure);
+	if (toneMapping)
+		post.addToneMap();
+	post.addClamp();
+	if (gamma != 1)
+		post.addGamma(gamma);
+	post.apply(img, threads);
 }
 
 void Scene::addObject(vector<Object*> o)
@@ -348,40 +1093,83 @@ void Scene::addLight(Light *l)
     lights.push_back(l);
 }
 
+/**
+ * Builds the BVH over all bounded objects. Must be called once all objects
+ * have been added, and before rendering.
+ */
+void Scene::buildAccelerator()
+{
+    bounded.clear();
+    unbounded.clear();
+    bvh = BVH();
+    acceleratorCost = 0;
+    if (!useAccelerator)
+        return;
+
+    std::vector<AABB> boxes;
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        AABB box = objects[i]->bounds();
+        if (box.isFinite())
+        {
+            bounded.push_back(objects[i]);
+            boxes.push_back(box);
+        }
+        else
+            unbounded.push_back(objects[i]);
+    }
+    bvh.build(boxes, builder, numThreads > 0 ? numThreads : TileScheduler::defaultThreads());
+    acceleratorCost = bvh.sahCost();
+    if (wideBVH)
+        bvh.collapse();
+}
+
 void Scene::setEye(Triple e)
 {
     eye = e;
 }
 
-
 /**
- * returns a list of object that contain the point p
- * 
- * if excepted is given, it won't be included in the list
+ * Rays are cut in order: below minRayWeight, by Russian roulette below
+ * rouletteWeight, then when the budget of their pixel is spent. Only rays
+ * that are traced take from the budget.
  */
-std::vector<Object*> Scene::getObjectsContaining(Point p, Object* excepted = NULL)
+double Scene::spawn(const Ray &ray, double factor, Ray &child)
 {
-	std::vector<Object*> result = std::vector<Object*>();
-	for (unsigned int i = 0 ; i< objects.size() ; i++)
-	{
-		if (objects[i]->hasWithin(p))
-		{
-			if (objects[i] != excepted)
-				result.push_back(objects[i]);
-		}
-	}
-	return result;
+    child.weight = ray.weight * factor;
+    child.budget = ray.budget;
+    if (factor <= 0 || child.weight < minRayWeight)
+        return 0;
+
+    // Below rouletteWeight, a ray is traced with a probability proportional
+    // to its weight, and then counts as much as a ray of rouletteWeight
+    double scale = 1;
+    if (child.weight < rouletteWeight && ray.budget)
+    {
+        double survival = child.weight / rouletteWeight;
+        if (ray.budget->next() >= survival)
+            return 0;
+        scale = 1 / survival;
+        child.weight = rouletteWeight;
+    }
+
+    if (ray.budget && ray.budget->raysLeft >= 0)
+    {
+        if (ray.budget->raysLeft == 0)
+            return 0;
+        ray.budget->raysLeft--;
+    }
+    return scale;
 }
 
-Vector Scene::getRefracted(Vector in, Vector normal, double eta1, double eta2)
+bool Scene::getRefracted(const Vector& in, const Vector& normal, double eta1, double eta2, Vector& refracted)
 {
-	Vector res;
 	double root = 1.0 - (((eta1*eta1)*(1.0 - (in.dot(normal)*in.dot(normal)))))/  (eta2*eta2);
 
+	// Beyond the critical angle: total internal reflection
 	if (root < 0)
-		throw "Oops";
-		
-	res = ((eta1*(in - normal*(in.dot(normal))))/eta2) - (normal*sqrt(root));
+		return false;
 		
-	return res;
+	refracted = ((eta1*(in - normal*(in.dot(normal))))/eta2) - (normal*sqrt(root));
+	return true;
 }
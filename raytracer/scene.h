@@ -30,17 +30,40 @@
 #include "light.h"
 #include "object.h"
 #include "image.h"
+#include "bvh.h"
+#include "stats.h"
 
 class Scene
 {
 public:
     enum RenderMode {
-        phong, zbuffer, normal, gooch
+        phong, zbuffer, normal, gooch,
+        cost // false colours for the work done per pixel by the phong render
+    };
+    // How secondary rays are followed: recursive traces each one as soon as
+    // it is spawned (depth first); wavefront keeps the rays of each bounce in
+    // a queue, sorts them by direction and origin, and traces them in that
+    // order (breadth first), batch by batch. Only the phong render has a
+    // wavefront. It is not faster than recursive yet, which stays the default.
+    enum Integrator { recursive, wavefront };
+    enum CostMeasure {
+        costTests,  // intersection tests (a pack of mesh faces counts as one)
+        costNodes,  // BVH nodes visited
+        costTime    // nanoseconds
     };
 
 private:
     std::vector<Object*> objects;
     std::vector<Light*> lights;
+    bool useAccelerator;
+    BVH::Builder builder; // of the scene BVH and of the meshes
+    bool wideBVH;         // whether both are collapsed into wide nodes
+    double acceleratorCost;
+    bool usePackets; // trace primary rays by packets of 4x4 pixels
+    Integrator integrator;
+    BVH bvh;
+    std::vector<Object*> bounded;   // objects referenced by the BVH
+    std::vector<Object*> unbounded; // objects tested for every ray (planes)
     Triple eye;
     RenderMode renderMode;
     double nearClippingDistance;
@@ -51,33 +74,140 @@ private:
     double focalLength;
     double focusDistance;
     int maxRecursionDepth;
+    double minRayWeight; // secondary rays counting less are not traced
+    double rouletteWeight; // Russian roulette below this weight (0: never)
+    int rayBudget; // secondary rays per pixel (0: no limit)
     Triple lookAt;
     Triple upVector;
     int width;
     int height;
     int superSamplingMult;
+    double adaptiveThreshold; // 0 to always use superSamplingMult
+    int maxSuperSamplingMult; // grid used for pixels on edges when adaptive
+    int numThreads; // 0 for one per core
+    double exposure; // in stops
+    bool toneMapping;
+    double gamma;
     float printProgression;
+    long long numPrimaryRays; // traced by the last render
+    RenderStats* stats; // what renders count and time (NULL: nothing)
     float b;
     float y;
     float alpha;
     float beta;
+    CostMeasure costMeasure;
+    bool costLogScale;
+    bool costLegend;
+
+    // Shading is compiled once per render mode and set of features, so that
+    // the features a scene does not use cost nothing per ray. The kernel
+    // for the scene is picked by selectKernel, at the start of each render.
+    enum KernelFeature {
+        KERNEL_SHADOWS = 1,    // shadow rays
+        KERNEL_REFRACTION = 2, // some materials are transparent
+        KERNEL_TEXTURES = 4    // some materials are textured
+    };
+    typedef Color (Scene::*ShadeKernel)(const Ray &ray, Object *obj, const Hit &min_hit, int recursionDepth);
+    ShadeKernel kernel;
+
+    template <RenderMode mode, int features>
+    Color traceKernel(const Ray &ray, int recursionDepth);
+    template <RenderMode mode, int features>
+    Color shadeKernel(const Ray &ray, Object *obj, const Hit &min_hit, int recursionDepth);
+    template <RenderMode mode>
+    static ShadeKernel kernelFor(int features);
+
+    // Phong shading of a hit. Every secondary ray is handed to
+    // follow(child, factor) as soon as it is spawned, which returns what it
+    // adds to the colour: factor times the colour seen along child when
+    // tracing recursively, nothing when it is queued for later.
+    // shadowed(i, hit) tells whether light i is hidden from the hit point,
+    // found there and then or beforehand for a whole batch of rays.
+    template <int features, class Follow, class Shadowed>
+    Color shadePhong(const Ray &ray, Object *obj, const Hit &min_hit, Follow follow, Shadowed shadowed);
+
+    // A ray of the wavefront integrator, waiting for its bounce
+    struct QueuedRay
+    {
+        Ray ray;
+        double factor; // how much its colour counts in its pixel
+        int pixel;     // index of the pixel in the colours of the stream
+
+        QueuedRay(const Ray &ray, double factor, int pixel) : ray(ray), factor(factor), pixel(pixel) { }
+    };
+    // Queues of one thread, kept from one tile to the next
+    struct Wavefront
+    {
+        std::vector<QueuedRay> queue, next;
+        std::vector<unsigned int> order, sorted; // indices in queue
+        std::vector<unsigned short> keys;
+        std::vector<char> shadowed; // per light, then per ray of the batch
+    };
+    typedef void (Scene::*WavefrontKernel)(Wavefront &stream, Color *colors, double *depths);
+    WavefrontKernel wavefrontKernel;
+
+    // Traces the primary rays in stream.queue and all their secondary rays
+    // bounce by bounce, adding what they see to colors[pixel], and empties
+    // the queue. depths[pixel], if given, is set to the distance of the
+    // primary hit (-1 for none).
+    template <int features>
+    void traceWavefront(Wavefront &stream, Color *colors, double *depths);
 
 public:
+    Scene() : useAccelerator(true), builder(BVH::sah), wideBVH(true),
+        acceleratorCost(0), usePackets(true), integrator(recursive), renderMode(phong), minRayWeight(0),
+        rouletteWeight(0), rayBudget(0), adaptiveThreshold(0),
+        maxSuperSamplingMult(4), numThreads(0), exposure(0), toneMapping(true),
+        gamma(1), numPrimaryRays(0), stats(NULL), costMeasure(costTests),
+        costLogScale(true), costLegend(true),
+        kernel(&Scene::shadeKernel<phong, KERNEL_SHADOWS | KERNEL_REFRACTION | KERNEL_TEXTURES>),
+        wavefrontKernel(&Scene::traceWavefront<KERNEL_SHADOWS | KERNEL_REFRACTION | KERNEL_TEXTURES>) { }
+
 	/**
 	 * *depth_p, if given, is filled with the depth at given pixel
 	 */
     Color trace(const Ray &ray, int recursionDepth=0, double* depth_p=0);
-    bool checkShadow(const Object* obj, const Point& hit, const Hit& min_hit, const Vector& L);
+    Color shade(const Ray &ray, Object *obj, const Hit &min_hit, int recursionDepth=0, double* depth_p=0);
+
+    // Picks the shading kernel for the current settings and objects
+    void selectKernel();
+
+    // Decides whether the secondary ray child, whose colour counts factor
+    // times in the colour of ray, is traced, and sets its weight and budget.
+    // Returns 0 if it is not, or what its colour must be multiplied by (more
+    // than 1 when it survived Russian roulette, so that the image stays the
+    // same on average).
+    double spawn(const Ray &ray, double factor, Ray &child);
+    Object* intersect(const Ray &ray, Hit &min_hit);
+    void intersectPacket(const RayPacket &packet, Hit *hits, Object **objs);
+    bool occluded(const Ray &ray, double maxDistance, Object **blocker = NULL);
+    bool checkShadow(Object* obj, int face, const Point& hit, const Point& lightPosition);
     void render(Image &img);
     void addObject(vector<Object*> o);
     void addLight(Light *l);
+    void buildAccelerator();
     void setEye(Triple e);
-    std::vector<Object*> getObjectsContaining(Point p, Object* excepted);
-    Vector getRefracted(Vector in, Vector normal, double eta1, double eta2);
+    // Direction of the ray of direction in refracted from a medium of index
+    // eta1 into one of index eta2, through a surface of normal `normal`
+    // (facing the ray). Returns false on total internal reflection.
+    bool getRefracted(const Vector& in, const Vector& normal, double eta1, double eta2, Vector& refracted);
     unsigned int getNumObjects() { return objects.size(); }
     unsigned int getNumLights() { return lights.size(); }
+    long long getNumPrimaryRays() { return numPrimaryRays; }
+    // stats must outlive the renders
+    void setStats(RenderStats* value) { stats = value; }
 
     void setRenderMode(RenderMode value) { renderMode = value; }
+    void setUseAccelerator(bool value) { useAccelerator = value; }
+    bool getUseAccelerator() { return useAccelerator; }
+    void setBuilder(BVH::Builder value) { builder = value; }
+    BVH::Builder getBuilder() { return builder; }
+    void setWideBVH(bool value) { wideBVH = value; }
+    bool getWideBVH() { return wideBVH; }
+    // SAH cost of the scene BVH, once built (see BVH::sahCost)
+    double getAcceleratorCost() { return acceleratorCost; }
+    void setUsePackets(bool value) { usePackets = value; }
+    void setIntegrator(Integrator value) { integrator = value; }
     void setNearClippingDistance(double value) { nearClippingDistance = value; }
     void setFarClippingDistance(double value) { farClippingDistance = value; }
     void setEnableShadows(bool value) { enableShadows = value; }
@@ -86,6 +216,9 @@ public:
     void setFocalLength(double value) {focalLength = value; }
     void setFocusDistance(double value) {focusDistance = value; }
     void setMaxRecursionDepth(int value) {maxRecursionDepth = value; }
+    void setMinRayWeight(double value) { minRayWeight = value; }
+    void setRouletteWeight(double value) { rouletteWeight = value; }
+    void setRayBudget(int value) { rayBudget = value; }
     void setLookAt(Triple value) { lookAt = value; }
     void setUpVector(Triple value) { upVector = value; }
     void setWidth(int value) { width = value; }
@@ -93,11 +226,21 @@ public:
     int getWidth() { return width; }
     int getHeight() { return height; }
     void setsuperSamplingMult(int value) { superSamplingMult = value; }
+    void setAdaptiveThreshold(double value) { adaptiveThreshold = value; }
+    void setMaxSuperSamplingMult(int value) { maxSuperSamplingMult = value; }
+    void setNumThreads(int value) { numThreads = value; }
+    int getNumThreads() { return numThreads; }
+    void setExposure(double value) { exposure = value; }
+    void setToneMapping(bool value) { toneMapping = value; }
+    void setGamma(double value) { gamma = value; }
     void setPrintProgression(float value) { printProgression = value; }
     void setB(float value) { b = value; }
     void setY(float value) { y = value; }
     void setAlpha(float value) { alpha = value; }
     void setBeta(float value) { beta = value; }
+    void setCostMeasure(CostMeasure value) { costMeasure = value; }
+    void setCostLogScale(bool value) { costLogScale = value; }
+    void setCostLegend(bool value) { costLegend = value; }
 };
 
 #endif /* end of include guard: SCENE_H_KNBLQLP6 */
@@ -0,0 +1,122 @@
+//
+//  Framework for a raytracer
+//  File: scheduler.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "scheduler.h"
+#include <atomic>
+#include <thread>
+
+TileScheduler::TileScheduler(int width, int height, int tileSize)
+{
+    for (int y = 0; y < height; y += tileSize)
+        for (int x = 0; x < width; x += tileSize)
+        {
+            Tile tile;
+            tile.x0 = x;
+            tile.y0 = y;
+            tile.x1 = x + tileSize < width ? x + tileSize : width;
+            tile.y1 = y + tileSize < height ? y + tileSize : height;
+            tiles.push_back(tile);
+        }
+}
+
+int TileScheduler::defaultThreads()
+{
+    int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+bool TileScheduler::popFront(Queue& queue, Tile& tile)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tiles.empty())
+        return false;
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return true;
+}
+
+bool TileScheduler::popBack(Queue& queue, Tile& tile)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tiles.empty())
+        return false;
+    tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return true;
+}
+
+void TileScheduler::run(int numThreads, const std::function<void(const Tile&, int)>& work)
+{
+    if (numThreads < 1)
+        numThreads = 1;
+
+    // Give every thread a contiguous band of tiles
+    std::vector<Queue> queues(numThreads);
+    for (unsigned int i = 0; i < tiles.size(); i++)
+        queues[i * numThreads / tiles.size()].tiles.push_back(tiles[i]);
+
+    auto worker = [&](int self)
+    {
+        Tile tile;
+        while (true)
+        {
+            // Own tiles are taken from the front, stolen ones from the back,
+            // so that the owner and the thieves work far apart in the image.
+            bool found = popFront(queues[self], tile);
+            for (int k = 1; !found && k < numThreads; k++)
+                found = popBack(queues[(self + k) % numThreads], tile);
+
+            // No tile is added once we started: if all the queues are empty,
+            // we are done.
+            if (!found)
+                return;
+            work(tile, self);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++)
+        threads.push_back(std::thread(worker, i));
+    worker(0);
+    for (unsigned int i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+void TileScheduler::parallelFor(int numThreads, int count, const std::function<void(int, int)>& work)
+{
+    if (numThreads < 1)
+        numThreads = 1;
+
+    // Rows are cheap and of similar cost: a shared counter is enough
+    std::atomic<int> next(0);
+    auto worker = [&](int self)
+    {
+        for (int i = next++; i < count; i = next++)
+            work(i, self);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads && i < count; i++)
+        threads.push_back(std::thread(worker, i));
+    worker(0);
+    for (unsigned int i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
@@ -0,0 +1,69 @@
+//
+//  Framework for a raytracer
+//  File: scheduler.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef SCHEDULER_H_FABIOUX_LEOBAL
+#define SCHEDULER_H_FABIOUX_LEOBAL
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Splits an image into square tiles and renders them on several threads.
+// Each thread starts with its own band of neighbouring tiles, and steals
+// tiles from the others once it is done, so that threads which got the cheap
+// parts of the image (sky, background) help with the expensive ones.
+class TileScheduler
+{
+public:
+    struct Tile
+    {
+        int x0, y0; // top left corner (included)
+        int x1, y1; // bottom right corner (excluded)
+    };
+
+    TileScheduler(int width, int height, int tileSize = 16);
+
+    // Calls work(tile, thread) once for every tile, from numThreads threads
+    // (the calling thread being one of them). thread is in [0, numThreads).
+    void run(int numThreads, const std::function<void(const Tile&, int)>& work);
+
+    // Calls work(i, thread) once for every i in [0, count), from numThreads
+    // threads. Used for the passes that go over whole rows or columns.
+    static void parallelFor(int numThreads, int count, const std::function<void(int, int)>& work);
+
+    // Number of threads to use when none is given (one per core)
+    static int defaultThreads();
+
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Tile> tiles;
+    };
+
+    std::vector<Tile> tiles;
+
+    static bool popFront(Queue& queue, Tile& tile);
+    static bool popBack(Queue& queue, Tile& tile);
+};
+
+#endif /* end of include guard: SCHEDULER_H_FABIOUX_LEOBAL */
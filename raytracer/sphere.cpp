@@ -20,12 +20,15 @@
 //
 
 #include "sphere.h"
+#include "stats.h"
 #include <math.h>
 
 /************************** Sphere **********************************/
 
 Hit Sphere::intersect(const Ray &ray)
 {
+    RenderStats::countTests(RenderCounters::spheres);
+
     // The equation of the points on our ray is the following:
     //     x = ray.O + ray.D * t
     // The equation of the points on a sphere is the following:
@@ -70,7 +73,8 @@ Hit Sphere::intersect(const Ray &ray)
     // With two possible solutions, we always pick the intersection which is
     // the closest to the ray's origin since we want to draw only that point:
     // we always take the smallest t (hence the -sqrt()).
-    double t = -dotProduct - sqrt(delta);
+    // A ray refracted into the sphere is inside: it leaves by the far side.
+    double t = ray.isInside(this) ? -dotProduct + sqrt(delta) : -dotProduct - sqrt(delta);
     if(t < 0)
         return Hit::NO_HIT();
 
@@ -83,7 +87,7 @@ Hit Sphere::intersect(const Ray &ray)
 }
 
 
-Color Sphere::colorAt(const Point& hit)
+Color Sphere::surfaceColor(const Point& hit, double footprint, const Material* material)
 {
 	if (material->texture == NULL)
 		return material->color;
@@ -94,7 +98,10 @@ Color Sphere::colorAt(const Point& hit)
     if(y > M_PI)
         y = 2*M_PI - y;
 
-    return material->texture->colorAt(x/(2*M_PI), y/M_PI);
+    // The texture spans half a circumference vertically: that many texels
+    // cover pi*r, and the footprint covers its share of them.
+    double texels = footprint * material->texture->height() / (M_PI * r);
+    return material->texture->colorAt(x/(2*M_PI), y/M_PI, texels);
 }
 
 void Sphere::rotate(const Vector& up, double spin)
@@ -117,3 +124,8 @@ bool Sphere::hasWithin(Point p)
 		return true;
 	return false;
 }
+
+AABB Sphere::bounds()
+{
+	return AABB(position - r, position + r);
+}
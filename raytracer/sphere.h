@@ -35,8 +35,9 @@ public:
 
     virtual Hit intersect(const Ray &ray);
     virtual bool hasWithin(Point p);
+    virtual AABB bounds();
     
-    virtual Color colorAt(const Point& hit);
+    virtual Color surfaceColor(const Point& hit, double footprint, const Material* material);
 
     // Rotate the sphere
     void rotate(const Vector& up, double spin);
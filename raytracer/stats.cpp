@@ -0,0 +1,112 @@
+//
+//  Framework for a raytracer
+//  File: stats.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "stats.h"
+#include <fstream>
+#include <iomanip>
+
+thread_local RenderCounters *RenderStats::local = NULL;
+thread_local RenderStats::Timer *RenderStats::current = NULL;
+
+void RenderCounters::clear()
+{
+    for (int i = 0; i < numRayTypes; i++)
+        rays[i] = 0;
+    for (int i = 0; i < numPrimitiveTypes; i++)
+        tests[i] = 0;
+    nodes = 0;
+}
+
+void RenderCounters::add(const RenderCounters &other)
+{
+    for (int i = 0; i < numRayTypes; i++)
+        rays[i] += other.rays[i];
+    for (int i = 0; i < numPrimitiveTypes; i++)
+        tests[i] += other.tests[i];
+    nodes += other.nodes;
+}
+
+RenderStats::RenderStats() : threads(0)
+{
+    for (int i = 0; i < numPhases; i++)
+        seconds[i] = 0;
+}
+
+bool RenderStats::writeJson(const std::string &fileName) const
+{
+    static const char* rayNames[RenderCounters::numRayTypes] = {
+        "primary", "shadow", "reflection", "refraction"
+    };
+    static const char* primitiveNames[RenderCounters::numPrimitiveTypes] = {
+        "sphere", "plane", "triangle", "cylinder", "trianglePack"
+    };
+    static const char* phaseNames[numPhases] = {
+        "parse", "load", "build", "trace", "depthOfField", "toneMap", "encode"
+    };
+
+    std::ofstream json(fileName.c_str());
+    if (!json)
+        return false;
+
+    double total = 0;
+    json << std::setprecision(6) << "{" << std::endl;
+    json << "  \"threads\": " << threads << "," << std::endl;
+    json << "  \"rays\": {";
+    for (int i = 0; i < RenderCounters::numRayTypes; i++)
+        json << (i ? ", " : " ") << "\"" << rayNames[i] << "\": " << counters.rays[i];
+    json << " }," << std::endl;
+    json << "  \"intersectionTests\": {";
+    for (int i = 0; i < RenderCounters::numPrimitiveTypes; i++)
+        json << (i ? ", " : " ") << "\"" << primitiveNames[i] << "\": " << counters.tests[i];
+    json << " }," << std::endl;
+    json << "  \"nodesVisited\": " << counters.nodes << "," << std::endl;
+    json << "  \"seconds\": {";
+    for (int i = 0; i < numPhases; i++)
+    {
+        json << (i ? ", " : " ") << "\"" << phaseNames[i] << "\": " << seconds[i];
+        total += seconds[i];
+    }
+    json << ", \"total\": " << total << " }" << std::endl;
+    json << "}" << std::endl;
+    return json.good();
+}
+
+RenderStats::Timer::Timer(RenderStats *stats, Phase phase)
+    : stats(stats), phase(phase), inner(0), parent(NULL)
+{
+    if (!stats)
+        return;
+    start = std::chrono::steady_clock::now();
+    parent = current;
+    current = this;
+}
+
+void RenderStats::Timer::stop()
+{
+    if (!stats)
+        return;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats->seconds[phase] += elapsed - inner;
+    if (parent)
+        parent->inner += elapsed;
+    current = parent;
+    stats = NULL;
+}
@@ -0,0 +1,102 @@
+//
+//  Framework for a raytracer
+//  File: stats.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef STATS_H_FABIOUX_LEOBAL
+#define STATS_H_FABIOUX_LEOBAL
+
+#include <chrono>
+#include <string>
+
+// What the threads of a render counted. Each thread counts into its own
+// counters, without atomics, and they are added up at the end of the render.
+struct RenderCounters
+{
+    enum RayType {
+        primaryRays, shadowRays, reflectionRays, refractionRays, numRayTypes
+    };
+    // Triangle packs are the faces of meshes, tested 4 or 8 at a time
+    enum PrimitiveType {
+        spheres, planes, triangles, cylinders, trianglePacks, numPrimitiveTypes
+    };
+
+    long long rays[numRayTypes];
+    long long tests[numPrimitiveTypes]; // intersection tests
+    long long nodes;                    // BVH nodes visited (scene and meshes)
+
+    RenderCounters() { clear(); }
+
+    void clear();
+    void add(const RenderCounters &other);
+};
+
+// Statistics of a scene, from the parsing of its file to the writing of its
+// image: the counters of its renders, and the time spent in each phase.
+//
+// Counting is done through the counters set for the calling thread, if any
+// (see setLocal): outside of renders with statistics, it costs one test.
+class RenderStats
+{
+public:
+    enum Phase {
+        parse, load, build, trace, depthOfField, toneMap, encode, numPhases
+    };
+
+    RenderCounters counters;
+    double seconds[numPhases];
+    int threads; // used by the last render
+
+    RenderStats();
+
+    static void setLocal(RenderCounters *counters) { local = counters; }
+    static const RenderCounters* getLocal() { return local; }
+    static void countRay(RenderCounters::RayType type) { if (local) local->rays[type]++; }
+    static void countTests(RenderCounters::PrimitiveType type, long long n = 1) { if (local) local->tests[type] += n; }
+    static void countNodes(long long n) { if (local) local->nodes += n; }
+
+    // Returns false if the file could not be written
+    bool writeJson(const std::string &fileName) const;
+
+    // Adds the time from its creation to stop() (or its destruction) to a
+    // phase. Phases can be nested: the time of the inner one is not counted
+    // in the outer one, so that the phases add up to the total. Does nothing
+    // if stats is NULL.
+    class Timer
+    {
+    public:
+        Timer(RenderStats *stats, Phase phase);
+        ~Timer() { stop(); }
+
+        void stop();
+
+    private:
+        RenderStats *stats;
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+        double inner;  // seconds spent in nested phases
+        Timer *parent; // enclosing timer on this thread
+    };
+
+private:
+    static thread_local RenderCounters *local;
+    static thread_local Timer *current;
+};
+
+#endif /* end of include guard: STATS_H_FABIOUX_LEOBAL */
@@ -0,0 +1,164 @@
+//
+//  Framework for a raytracer
+//  File: texture.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "texture.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include "lodepng.h"
+
+std::map<std::string, Texture*> Texture::cache;
+std::mutex Texture::cacheLock;
+
+Texture* Texture::load(const std::string& fileName)
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    std::map<std::string, Texture*>::iterator found = cache.find(fileName);
+    if (found != cache.end())
+    {
+        found->second->references++;
+        return found->second;
+    }
+
+    Texture* texture = new Texture(fileName);
+    if (!texture->decode())
+    {
+        std::cerr << "Warning: can't read texture \"" << fileName << "\", ignored." << std::endl;
+        delete texture;
+        return nullptr;
+    }
+    texture->references = 1;
+    cache[fileName] = texture;
+    return texture;
+}
+
+void Texture::release()
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    if (--references > 0)
+        return;
+    cache.erase(fileName);
+    delete this;
+}
+
+bool Texture::decode()
+{
+    std::vector<unsigned char> buffer;
+    LodePNG::loadFile(buffer, fileName);
+    if (buffer.empty())
+        return false;
+
+    // LodePNG converts any PNG to 8-bit RGBA, which is what we keep
+    std::vector<unsigned char> image;
+    LodePNG::Decoder decoder;
+    decoder.decode(image, &buffer[0], (unsigned)buffer.size());
+    int w = decoder.getWidth(), h = decoder.getHeight();
+    if (decoder.hasError() || w == 0 || h == 0 || image.size() != 4 * (size_t)w * h)
+        return false;
+
+    levels.resize(1);
+    levels[0].resize(w, h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            memcpy(&levels[0].texels[levels[0].offset(x, y)], &image[4 * (y * w + x)], 4);
+    buildLevels();
+    return true;
+}
+
+void Texture::Level::resize(int w, int h)
+{
+    width = w;
+    height = h;
+    tilesX = (w + 3) / 4;
+    texels.assign(tilesX * ((h + 3) / 4) * 16 * 4, 0);
+}
+
+// Every level is the previous one halved, each texel being the average of
+// 2x2 texels (the last row or column is repeated for odd sizes)
+void Texture::buildLevels()
+{
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        levels.push_back(Level());
+        const Level& from = levels[levels.size() - 2];
+        Level& to = levels.back();
+        to.resize(std::max(1, from.width / 2), std::max(1, from.height / 2));
+        for (int y = 0; y < to.height; y++)
+        {
+            int y0 = std::min(2*y, from.height - 1), y1 = std::min(2*y + 1, from.height - 1);
+            for (int x = 0; x < to.width; x++)
+            {
+                int x0 = std::min(2*x, from.width - 1), x1 = std::min(2*x + 1, from.width - 1);
+                const unsigned char* a = &from.texels[from.offset(x0, y0)];
+                const unsigned char* b = &from.texels[from.offset(x1, y0)];
+                const unsigned char* c = &from.texels[from.offset(x0, y1)];
+                const unsigned char* d = &from.texels[from.offset(x1, y1)];
+                unsigned char* texel = &to.texels[to.offset(x, y)];
+                for (int k = 0; k < 4; k++)
+                    texel[k] = (a[k] + b[k] + c[k] + d[k] + 2) / 4;
+            }
+        }
+    }
+}
+
+// Adds weight times the bilinear interpolation of the level at (x, y)
+// to rgb. Texel centers are at half-integer coordinates.
+void Texture::bilinear(const Level& level, float x, float y, float weight, float* rgb) const
+{
+    float fx = x * level.width - 0.5f;
+    float fy = y * level.height - 0.5f;
+    float floorX = floorf(fx), floorY = floorf(fy);
+    float tx = fx - floorX, ty = fy - floorY;
+
+    int x0 = (int)floorX % level.width;
+    if (x0 < 0)
+        x0 += level.width;
+    int x1 = x0 + 1 < level.width ? x0 + 1 : 0;
+    int y0 = std::min(std::max((int)floorY, 0), level.height - 1);
+    int y1 = std::min(std::max((int)floorY + 1, 0), level.height - 1);
+
+    const unsigned char* a = &level.texels[level.offset(x0, y0)];
+    const unsigned char* b = &level.texels[level.offset(x1, y0)];
+    const unsigned char* c = &level.texels[level.offset(x0, y1)];
+    const unsigned char* d = &level.texels[level.offset(x1, y1)];
+    float wa = (1 - tx) * (1 - ty), wb = tx * (1 - ty), wc = (1 - tx) * ty, wd = tx * ty;
+    for (int k = 0; k < 3; k++)
+        rgb[k] += weight * (wa * a[k] + wb * b[k] + wc * c[k] + wd * d[k]);
+}
+
+Color Texture::colorAt(float x, float y, float size) const
+{
+    float rgb[3] = { 0, 0, 0 };
+    float level = size > 1 ? log2f(size) : 0;
+    int last = levels.size() - 1;
+    if (level >= last)
+        bilinear(levels[last], x, y, 1, rgb);
+    else
+    {
+        int l = (int)level;
+        float t = level - l;
+        bilinear(levels[l], x, y, 1 - t, rgb);
+        if (t > 0)
+            bilinear(levels[l + 1], x, y, t, rgb);
+    }
+    return Color(rgb[0] / 255.0, rgb[1] / 255.0, rgb[2] / 255.0);
+}
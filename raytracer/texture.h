@@ -0,0 +1,97 @@
+//
+//  Framework for a raytracer
+//  File: texture.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef TEXTURE_H_FABIOUX_LEOBAL
+#define TEXTURE_H_FABIOUX_LEOBAL
+
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "triple.h"
+
+// Image mapped on objects. Texels are stored as 8-bit RGBA (4 bytes, where
+// an Image pixel takes 24), and every file is decoded only once: textures
+// are shared by all the materials naming the same file, and counted so that
+// the last material to release one frees it.
+//
+// Each texture is a mip pyramid (the image, then halved again and again down
+// to one texel), so that a surface seen from afar is sampled in a level
+// where one texel covers about what the ray covers, instead of aliasing.
+// Levels are stored in tiles of 4x4 texels, which take one 64-byte cache
+// line, with the texels of a tile in Morton (Z) order: the four texels of
+// a bilinear lookup are nearly always in the same line.
+class Texture
+{
+public:
+    // Returns the texture of the given PNG file, decoding it only if no
+    // material holds it yet, or nullptr (with a warning) if it can't be read.
+    // Every successful call must be matched by a call to release().
+    static Texture* load(const std::string& fileName);
+
+    void release();
+
+    // Colour at normalized coordinates in [0, 1] x [0, 1] (x wraps around,
+    // y is clamped), for a ray whose footprint spans `size` texels of the
+    // full image: bilinear lookups in the two levels around log2(size), then
+    // blended (trilinear filtering). size <= 1 is plain bilinear.
+    Color colorAt(float x, float y, float size) const;
+
+    int width() const { return levels[0].width; }
+    int height() const { return levels[0].height; }
+    int numLevels() const { return levels.size(); }
+
+private:
+    struct Level
+    {
+        int width, height;
+        int tilesX; // tiles per row
+        std::vector<unsigned char> texels; // RGBA, tile after tile
+
+        void resize(int w, int h);
+
+        // Offset of texel (x, y) in texels
+        int offset(int x, int y) const
+        {
+            int inTile = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2;
+            return (((y >> 2) * tilesX + (x >> 2)) * 16 + inTile) * 4;
+        }
+    };
+
+    std::string fileName;
+    std::vector<Level> levels;
+    int references;
+
+    // All the textures in use, by file name
+    static std::map<std::string, Texture*> cache;
+    static std::mutex cacheLock;
+
+    Texture(const std::string& fileName) : fileName(fileName), references(0) { }
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+
+    bool decode();
+    void buildLevels();
+    void bilinear(const Level& level, float x, float y, float weight, float* rgb) const;
+};
+
+#endif /* end of include guard: TEXTURE_H_FABIOUX_LEOBAL */
@@ -0,0 +1,111 @@
+//
+//  Framework for a raytracer
+//  File: transform.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "transform.h"
+
+Transform::Transform()
+{
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 4; j++)
+            m[i][j] = i == j ? 1 : 0;
+}
+
+Transform Transform::translation(const Vector& t)
+{
+    Transform r;
+    for (int i = 0; i < 3; i++)
+        r.m[i][3] = t.data[i];
+    return r;
+}
+
+Transform Transform::scaling(const Vector& s)
+{
+    Transform r;
+    for (int i = 0; i < 3; i++)
+        r.m[i][i] = s.data[i];
+    return r;
+}
+
+Transform Transform::rotation(int axis, double degrees)
+{
+    // The two other axes, in the order that makes the rotation
+    // counter-clockwise when looking down the axis
+    int a = (axis + 1) % 3, b = (axis + 2) % 3;
+    double c = cos(degrees * M_PI / 180), s = sin(degrees * M_PI / 180);
+    Transform r;
+    r.m[a][a] = c;
+    r.m[a][b] = -s;
+    r.m[b][a] = s;
+    r.m[b][b] = c;
+    return r;
+}
+
+Transform Transform::operator*(const Transform& other) const
+{
+    Transform r;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            r.m[i][j] = m[i][0]*other.m[0][j] + m[i][1]*other.m[1][j] + m[i][2]*other.m[2][j];
+            if (j == 3)
+                r.m[i][j] += m[i][3];
+        }
+    }
+    return r;
+}
+
+AABB Transform::box(const AABB& b) const
+{
+    AABB r;
+    if (b.isEmpty())
+        return r;
+    for (int corner = 0; corner < 8; corner++)
+        r.extend(point(Point(corner & 1 ? b.max.x : b.min.x,
+                             corner & 2 ? b.max.y : b.min.y,
+                             corner & 4 ? b.max.z : b.min.z)));
+    return r;
+}
+
+bool Transform::inverse(Transform& inv) const
+{
+    // Inverse of M from its cofactors
+    double c[3][3];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+        {
+            int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            c[i][j] = m[i1][j1]*m[i2][j2] - m[i1][j2]*m[i2][j1];
+        }
+    double det = m[0][0]*c[0][0] + m[0][1]*c[0][1] + m[0][2]*c[0][2];
+    if (fabs(det) < 1e-12)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            inv.m[i][j] = c[j][i] / det;
+
+    // p = M q + T  <=>  q = M^-1 p - M^-1 T
+    for (int i = 0; i < 3; i++)
+        inv.m[i][3] = -(inv.m[i][0]*m[0][3] + inv.m[i][1]*m[1][3] + inv.m[i][2]*m[2][3]);
+    return true;
+}
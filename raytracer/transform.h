@@ -0,0 +1,77 @@
+//
+//  Framework for a raytracer
+//  File: transform.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef TRANSFORM_H_FABIOUX_LEOBAL
+#define TRANSFORM_H_FABIOUX_LEOBAL
+
+#include "triple.h"
+#include "aabb.h"
+
+// Affine transform p -> M p + T, stored as the rows of the 3x4 matrix [M T].
+// Transforms combine like matrices: (a * b) applies b, then a.
+class Transform
+{
+public:
+    double m[3][4];
+
+    // Identity
+    Transform();
+
+    static Transform translation(const Vector& t);
+    static Transform scaling(const Vector& s);
+    // Rotation by angle degrees around the x (0), y (1) or z (2) axis
+    static Transform rotation(int axis, double degrees);
+
+    Transform operator*(const Transform& other) const;
+
+    Point point(const Point& p) const
+    {
+        return Point(m[0][0]*p.x + m[0][1]*p.y + m[0][2]*p.z + m[0][3],
+                     m[1][0]*p.x + m[1][1]*p.y + m[1][2]*p.z + m[1][3],
+                     m[2][0]*p.x + m[2][1]*p.y + m[2][2]*p.z + m[2][3]);
+    }
+
+    // Directions are not translated
+    Vector vector(const Vector& v) const
+    {
+        return Vector(m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z,
+                      m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z,
+                      m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z);
+    }
+
+    // Multiplies by the transpose of M: normals are carried from the space
+    // of a transform to the other by the transpose of its inverse, so this
+    // is called on the inverse. The result is not normalized.
+    Vector transposedVector(const Vector& v) const
+    {
+        return Vector(m[0][0]*v.x + m[1][0]*v.y + m[2][0]*v.z,
+                      m[0][1]*v.x + m[1][1]*v.y + m[2][1]*v.z,
+                      m[0][2]*v.x + m[1][2]*v.y + m[2][2]*v.z);
+    }
+
+    // Box enclosing the transformed box
+    AABB box(const AABB& b) const;
+
+    // Returns false (leaving inv as is) if the transform is singular
+    bool inverse(Transform& inv) const;
+};
+
+#endif /* end of include guard: TRANSFORM_H_FABIOUX_LEOBAL */
@@ -20,6 +20,7 @@
 //
 
 #include "triangle.h"
+#include "stats.h"
 #include <math.h>
 
 #define TRIANGLE_CCW
@@ -38,6 +39,8 @@ Triangle::Triangle(Point p0, Point p1, Point p2) :
 
 Hit Triangle::intersect(const Ray &ray)
 {
+    RenderStats::countTests(RenderCounters::triangles);
+
     // Using Möller-Trumbore intersection algorithm.
     // Reference: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
 
@@ -104,3 +107,12 @@ bool Triangle::hasWithin(Point p)
 	//TODO/FIXME
 	return false;
 }
+
+AABB Triangle::bounds()
+{
+	AABB box;
+	box.extend(p0);
+	box.extend(p1);
+	box.extend(p2);
+	return box;
+}
@@ -33,6 +33,7 @@ public:
 
     virtual Hit intersect(const Ray &ray);
     virtual bool hasWithin(Point p);
+    virtual AABB bounds();
 
     const Point p0, p1, p2;
     const Vector N;
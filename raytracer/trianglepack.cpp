@@ -0,0 +1,210 @@
+//
+//  Framework for a raytracer
+//  File: trianglepack.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#include "trianglepack.h"
+
+// Same as in Triangle::intersect
+#define PACK_EPSILON 0.0000001f
+
+TrianglePack::TrianglePack()
+{
+    for (int i = 0; i < TRIANGLE_PACK_WIDTH; i++)
+    {
+        v0x[i] = v0y[i] = v0z[i] = 0.0f;
+        e1x[i] = e1y[i] = e1z[i] = 0.0f;
+        e2x[i] = e2y[i] = e2z[i] = 0.0f;
+        face[i] = -1;
+    }
+}
+
+void TrianglePack::set(int lane, const Point& p0, const Point& p1, const Point& p2, int f)
+{
+    Vector e1 = p1 - p0, e2 = p2 - p0;
+    v0x[lane] = p0.x; v0y[lane] = p0.y; v0z[lane] = p0.z;
+    e1x[lane] = e1.x; e1y[lane] = e1.y; e1z[lane] = e1.z;
+    e2x[lane] = e2.x; e2y[lane] = e2.y; e2z[lane] = e2.z;
+    face[lane] = f;
+}
+
+// Picks the lane with the smallest distance among the lanes set in `bits`
+static inline int nearestLane(int bits, const float* ts, float& t)
+{
+    int best = -1;
+    for (int i = 0; i < TRIANGLE_PACK_WIDTH; i++)
+        if ((bits >> i) & 1 && (best < 0 || ts[i] < ts[best]))
+            best = i;
+    t = ts[best];
+    return best;
+}
+
+int intersectPackScalar(const TrianglePack& p, const PackRay& r, int skipFace, float tMax, float& t)
+{
+    float ts[TRIANGLE_PACK_WIDTH];
+    int bits = 0;
+    for (int i = 0; i < TRIANGLE_PACK_WIDTH; i++)
+    {
+        if (p.face[i] == skipFace)
+            continue;
+
+        // uvec = D x e2
+        float ux = r.dy * p.e2z[i] - r.dz * p.e2y[i];
+        float uy = r.dz * p.e2x[i] - r.dx * p.e2z[i];
+        float uz = r.dx * p.e2y[i] - r.dy * p.e2x[i];
+        float det = p.e1x[i] * ux + p.e1y[i] * uy + p.e1z[i] * uz;
+        if (!(det >= PACK_EPSILON))
+            continue;
+        float invDet = 1.0f / det;
+
+        // tvec = O - v0
+        float tx = r.ox - p.v0x[i], ty = r.oy - p.v0y[i], tz = r.oz - p.v0z[i];
+        float u = (tx * ux + ty * uy + tz * uz) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            continue;
+
+        // vvec = tvec x e1
+        float vx = ty * p.e1z[i] - tz * p.e1y[i];
+        float vy = tz * p.e1x[i] - tx * p.e1z[i];
+        float vz = tx * p.e1y[i] - ty * p.e1x[i];
+        float v = (r.dx * vx + r.dy * vy + r.dz * vz) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            continue;
+
+        ts[i] = (p.e2x[i] * vx + p.e2y[i] * vy + p.e2z[i] * vz) * invDet;
+        if (ts[i] > PACK_EPSILON && ts[i] < tMax)
+            bits |= 1 << i;
+    }
+    if (!bits)
+        return -1;
+    return nearestLane(bits, ts, t);
+}
+
+#if defined(__AVX2__)
+
+int intersectPack(const TrianglePack& p, const PackRay& r, int skipFace, float tMax, float& t)
+{
+    const __m256 eps = _mm256_set1_ps(PACK_EPSILON);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 dx = _mm256_set1_ps(r.dx), dy = _mm256_set1_ps(r.dy), dz = _mm256_set1_ps(r.dz);
+
+    __m256 e1x = _mm256_load_ps(p.e1x), e1y = _mm256_load_ps(p.e1y), e1z = _mm256_load_ps(p.e1z);
+    __m256 e2x = _mm256_load_ps(p.e2x), e2y = _mm256_load_ps(p.e2y), e2z = _mm256_load_ps(p.e2z);
+
+    // uvec = D x e2, det = e1 . uvec
+    __m256 ux = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 uy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 uz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, ux), _mm256_mul_ps(e1y, uy)), _mm256_mul_ps(e1z, uz));
+    __m256 mask = _mm256_cmp_ps(det, eps, _CMP_GE_OQ);
+    __m256 invDet = _mm256_div_ps(one, det);
+
+    // tvec = O - v0, u = tvec . uvec / det
+    __m256 tx = _mm256_sub_ps(_mm256_set1_ps(r.ox), _mm256_load_ps(p.v0x));
+    __m256 ty = _mm256_sub_ps(_mm256_set1_ps(r.oy), _mm256_load_ps(p.v0y));
+    __m256 tz = _mm256_sub_ps(_mm256_set1_ps(r.oz), _mm256_load_ps(p.v0z));
+    __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, ux), _mm256_mul_ps(ty, uy)), _mm256_mul_ps(tz, uz)), invDet);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+
+    // vvec = tvec x e1, v = D . vvec / det
+    __m256 vx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+    __m256 vy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+    __m256 vz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+    __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, vx), _mm256_mul_ps(dy, vy)), _mm256_mul_ps(dz, vz)), invDet);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+
+    // distance = e2 . vvec / det
+    __m256 dist = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, vx), _mm256_mul_ps(e2y, vy)), _mm256_mul_ps(e2z, vz)), invDet);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(dist, eps, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(dist, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+    __m256i skip = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)p.face), _mm256_set1_epi32(skipFace));
+    mask = _mm256_andnot_ps(_mm256_castsi256_ps(skip), mask);
+
+    int bits = _mm256_movemask_ps(mask);
+    if (!bits)
+        return -1;
+    float ts[TRIANGLE_PACK_WIDTH];
+    _mm256_storeu_ps(ts, dist);
+    return nearestLane(bits, ts, t);
+}
+
+#elif defined(__SSE2__)
+
+int intersectPack(const TrianglePack& p, const PackRay& r, int skipFace, float tMax, float& t)
+{
+    const __m128 eps = _mm_set1_ps(PACK_EPSILON);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 dx = _mm_set1_ps(r.dx), dy = _mm_set1_ps(r.dy), dz = _mm_set1_ps(r.dz);
+
+    __m128 e1x = _mm_load_ps(p.e1x), e1y = _mm_load_ps(p.e1y), e1z = _mm_load_ps(p.e1z);
+    __m128 e2x = _mm_load_ps(p.e2x), e2y = _mm_load_ps(p.e2y), e2z = _mm_load_ps(p.e2z);
+
+    // uvec = D x e2, det = e1 . uvec
+    __m128 ux = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 uy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 uz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, ux), _mm_mul_ps(e1y, uy)), _mm_mul_ps(e1z, uz));
+    __m128 mask = _mm_cmpge_ps(det, eps);
+    __m128 invDet = _mm_div_ps(one, det);
+
+    // tvec = O - v0, u = tvec . uvec / det
+    __m128 tx = _mm_sub_ps(_mm_set1_ps(r.ox), _mm_load_ps(p.v0x));
+    __m128 ty = _mm_sub_ps(_mm_set1_ps(r.oy), _mm_load_ps(p.v0y));
+    __m128 tz = _mm_sub_ps(_mm_set1_ps(r.oz), _mm_load_ps(p.v0z));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, ux), _mm_mul_ps(ty, uy)), _mm_mul_ps(tz, uz)), invDet);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(u, one));
+
+    // vvec = tvec x e1, v = D . vvec / det
+    __m128 vx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 vy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 vz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, vx), _mm_mul_ps(dy, vy)), _mm_mul_ps(dz, vz)), invDet);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+
+    // distance = e2 . vvec / det
+    __m128 dist = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, vx), _mm_mul_ps(e2y, vy)), _mm_mul_ps(e2z, vz)), invDet);
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(dist, eps));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(dist, _mm_set1_ps(tMax)));
+
+    __m128i skip = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)p.face), _mm_set1_epi32(skipFace));
+    mask = _mm_andnot_ps(_mm_castsi128_ps(skip), mask);
+
+    int bits = _mm_movemask_ps(mask);
+    if (!bits)
+        return -1;
+    float ts[TRIANGLE_PACK_WIDTH];
+    _mm_storeu_ps(ts, dist);
+    return nearestLane(bits, ts, t);
+}
+
+#else
+
+int intersectPack(const TrianglePack& p, const PackRay& r, int skipFace, float tMax, float& t)
+{
+    return intersectPackScalar(p, r, skipFace, tMax, t);
+}
+
+#endif
@@ -0,0 +1,82 @@
+//
+//  Framework for a raytracer
+//  File: trianglepack.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+#ifndef TRIANGLEPACK_H_FABIOUX_LEOBAL
+#define TRIANGLEPACK_H_FABIOUX_LEOBAL
+
+#include <limits>
+#include "light.h"
+
+// Width of a pack: 8 triangles with AVX2 (compile with -mavx2 or
+// -march=native), 4 with SSE, which every x86-64 processor has. Other
+// processors get a plain loop over 4 triangles.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRIANGLE_PACK_WIDTH 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TRIANGLE_PACK_WIDTH 4
+#else
+#define TRIANGLE_PACK_WIDTH 4
+#endif
+
+// A few triangles stored coordinate by coordinate (one array per component),
+// so that one ray can be tested against all of them at once. Triangles are
+// stored as a vertex and two edges, in single precision.
+// Unused lanes have null edges (and face -1), which are never hit.
+struct alignas(32) TrianglePack
+{
+    float v0x[TRIANGLE_PACK_WIDTH], v0y[TRIANGLE_PACK_WIDTH], v0z[TRIANGLE_PACK_WIDTH];
+    float e1x[TRIANGLE_PACK_WIDTH], e1y[TRIANGLE_PACK_WIDTH], e1z[TRIANGLE_PACK_WIDTH];
+    float e2x[TRIANGLE_PACK_WIDTH], e2y[TRIANGLE_PACK_WIDTH], e2z[TRIANGLE_PACK_WIDTH];
+    int face[TRIANGLE_PACK_WIDTH];
+
+    TrianglePack();
+
+    // Stores the triangle (p0, p1, p2) with id `face` in the given lane
+    void set(int lane, const Point& p0, const Point& p1, const Point& p2, int face);
+};
+
+// Single precision copy of a ray, made once per ray and reused for every pack
+struct PackRay
+{
+    float ox, oy, oz;
+    float dx, dy, dz;
+
+    PackRay() { }
+
+    PackRay(const Ray& ray)
+        : ox(ray.O.x), oy(ray.O.y), oz(ray.O.z),
+          dx(ray.D.x), dy(ray.D.y), dz(ray.D.z)
+    { }
+};
+
+// Möller-Trumbore on every triangle of the pack at once, with the same
+// conventions as Triangle::intersect (back faces are culled). Returns the
+// lane of the nearest triangle hit closer than tMax, and its distance in t,
+// or -1 if none is. Triangles whose face is skipFace are ignored.
+int intersectPack(const TrianglePack& pack, const PackRay& ray, int skipFace, float tMax, float& t);
+
+// Plain C++ version of the same test, for processors without SSE and for
+// comparison.
+int intersectPackScalar(const TrianglePack& pack, const PackRay& ray, int skipFace, float tMax, float& t);
+
+#endif /* end of include guard: TRIANGLEPACK_H_FABIOUX_LEOBAL */
@@ -0,0 +1,97 @@
+//
+//  Framework for a raytracer
+//  File: widenode.cpp
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+
+#include "widenode.h"
+
+void WideNode::setBounds(const AABB& bounds)
+{
+    numChildren = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // Lower corner rounded down to single precision
+        double min = bounds.min.data[axis], max = bounds.max.data[axis];
+        float o = (float)min;
+        if (o > min)
+            o = nextafterf(o, -INFINITY);
+        origin[axis] = o;
+
+        // Smallest step with which 255 steps cover the box
+        int e = -126;
+        if (max > o)
+        {
+            frexp((max - o) / 255.0, &e);
+            if (e < -126) e = -126;
+            if (e > 127) e = 127;
+        }
+        exponent[axis] = e;
+        while (coordinate(axis, 255) < max && exponent[axis] < 127)
+            exponent[axis]++;
+    }
+}
+
+void WideNode::addChild(const AABB& box, uint32_t index, uint16_t n)
+{
+    int slot = numChildren++;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double s = scale(axis);
+        double qLo = floor((box.min.data[axis] - origin[axis]) / s);
+        double qHi = ceil((box.max.data[axis] - origin[axis]) / s);
+        int low = qLo < 0 ? 0 : qLo > 255 ? 255 : (int)qLo;
+        int high = qHi < 0 ? 0 : qHi > 255 ? 255 : (int)qHi;
+
+        // The division may have rounded the wrong way
+        while (low > 0 && coordinate(axis, low) > box.min.data[axis])
+            low--;
+        while (high < 255 && coordinate(axis, high) < box.max.data[axis])
+            high++;
+        lo[axis][slot] = low;
+        hi[axis][slot] = high;
+    }
+    child[slot] = index;
+    count[slot] = n;
+}
+
+WidePacket::WidePacket(const WideRay* rays, int size) : coherent(size > 0)
+{
+    for (int axis = 0; axis < 3 && coherent; axis++)
+    {
+        sign[axis] = rays[0].inv[axis] < 0 ? -1.0f : 1.0f;
+        float oMin = rays[0].o[axis], oMax = oMin;
+        invMin[axis] = invMax[axis] = fabsf(rays[0].inv[axis]);
+        for (int i = 1; i < size; i++)
+        {
+            if ((rays[i].inv[axis] < 0) != (sign[axis] < 0))
+                coherent = false;
+            float inv = fabsf(rays[i].inv[axis]);
+            if (rays[i].o[axis] < oMin) oMin = rays[i].o[axis];
+            if (rays[i].o[axis] > oMax) oMax = rays[i].o[axis];
+            if (inv < invMin[axis]) invMin[axis] = inv;
+            if (inv > invMax[axis]) invMax[axis] = inv;
+        }
+
+        // The entries are nearest from the origin farthest along the
+        // direction, the exits farthest from the other one
+        oEntry[axis] = sign[axis] > 0 ? oMax : oMin;
+        oExit[axis] = sign[axis] > 0 ? oMin : oMax;
+    }
+}
@@ -0,0 +1,259 @@
+//
+//  Framework for a raytracer
+//  File: widenode.h
+//
+//  Created for the Computer Science course "Introduction Computer Graphics"
+//  taught at the University of Groningen by Tobias Isenberg.
+//
+//  Authors:
+//    Maarten Everts
+//    Jasper van de Gronde
+//
+//  Students:
+//    Vincent Fabioux
+//    Olivier Léobal
+//
+//
+//  This framework is inspired by and uses code of the raytracer framework of 
+//  Bert Freudenberg that can be found at
+//  http://isgwww.cs.uni-magdeburg.de/graphik/lehre/cg2/projekt/rtprojekt.html 
+//
+
+
+#ifndef WIDENODE_H_FABIOUX_LEOBAL
+#define WIDENODE_H_FABIOUX_LEOBAL
+
+#include <cfloat>
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+#include "aabb.h"
+#include "light.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Number of children of a wide node: their boxes are tested at once with SSE,
+// which every x86-64 processor has. Other processors get a plain loop.
+#define WIDE_NODE_WIDTH 4
+
+// Relative margin on the far distances of the box tests, which are done in
+// single precision, so that rounding never culls a box the ray touches.
+#define WIDE_NODE_SLACK 1.000001f
+
+// Single precision copy of a ray, made once per ray and reused for every node.
+// Inverse directions are kept finite, and positive for null directions, so
+// that a ray lying in the plane of a slab gives 0 instead of 0 * inf = NaN.
+struct WideRay
+{
+    float o[3];
+    float inv[3];
+#if defined(__SSE2__)
+    __m128 o4[3], inv4[3]; // the same in every lane
+#endif
+
+    WideRay() { }
+
+    WideRay(const Ray& ray)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            o[i] = ray.O.data[i];
+            double inverse = ray.D.data[i] != 0.0 ? 1.0 / ray.D.data[i] : FLT_MAX;
+            inv[i] = inverse > FLT_MAX ? FLT_MAX : inverse < -FLT_MAX ? -FLT_MAX : (float)inverse;
+#if defined(__SSE2__)
+            o4[i] = _mm_set1_ps(o[i]);
+            inv4[i] = _mm_set1_ps(inv[i]);
+#endif
+        }
+    }
+
+    // Bound to test the boxes with for a ray bounded by t: rounded up to
+    // single precision, with the margin.
+    static float bound(double t)
+    {
+        float f = (float)t;
+        if (f < t)
+            f = nextafterf(f, INFINITY);
+        return f * WIDE_NODE_SLACK;
+    }
+};
+
+// Bounds of the origins and inverse directions of the rays of a packet, to
+// reject the children that all of them miss in one test (interval
+// arithmetic). Only usable when the directions of all the rays have the same
+// signs, which makes the nearest and farthest side of every slab the same for
+// all of them.
+struct WidePacket
+{
+    bool coherent;
+    float sign[3];           // of the inverse directions, 1 or -1
+    float oEntry[3];         // origin bound the entries are measured from
+    float oExit[3];          // and the exits
+    float invMin[3], invMax[3]; // bounds of the magnitudes of the inverses
+
+    WidePacket(const WideRay* rays, int size);
+};
+
+// Node of a hierarchy of WIDE_NODE_WIDTH children, in one cache line. The
+// bounds of the children are stored in 8 bits per coordinate, as steps of
+// 2^exponent from the lower corner of the node, rounded outwards: they are a
+// little larger than the real ones, never smaller.
+// A child is either another node (count 0, child is its index), or a leaf of
+// count primitives starting at child. Slots from numChildren on are unused.
+struct alignas(64) WideNode
+{
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t numChildren;
+    uint8_t lo[3][WIDE_NODE_WIDTH];
+    uint8_t hi[3][WIDE_NODE_WIDTH];
+    uint32_t child[WIDE_NODE_WIDTH];
+    uint16_t count[WIDE_NODE_WIDTH];
+
+    WideNode() : numChildren(0) { }
+
+    // Sets the bounds the children are stored relative to. Must be called
+    // before adding them.
+    void setBounds(const AABB& bounds);
+
+    // Adds a child covering box (see above for child and count)
+    void addChild(const AABB& box, uint32_t child, uint16_t count);
+
+    // Tests the ray against the boxes of all the children, between 0 and
+    // tMax (see WideRay::bound). Returns the mask of the children hit, and
+    // stores the entry distance of each in tNear.
+    int intersect(const WideRay& ray, float tMax, float* tNear) const;
+
+    // Mask of the children that some ray of the coherent packet may hit
+    // before tMax, the largest bound of its rays
+    int intersect(const WidePacket& packet, float tMax) const;
+
+private:
+    // Step of the coordinates along an axis: 2^exponent
+    float scale(int axis) const
+    {
+        uint32_t bits = (uint32_t)(exponent[axis] + 127) << 23;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // Coordinate stored as q along an axis. Computed in double then
+    // rounded, which gives the same float as the traversal: q * scale is
+    // exact, so only the sum is rounded, with or without fused operations.
+    float coordinate(int axis, int q) const
+    {
+        return (float)((double)origin[axis] + q * (double)scale(axis));
+    }
+
+#if defined(__SSE2__)
+    // Lower and upper coordinates of the children along an axis
+    void coordinates(int axis, __m128& low, __m128& high) const
+    {
+        // Widen the 4 bytes of each side to 4 floats
+        __m128i zero = _mm_setzero_si128();
+        int32_t loBytes, hiBytes;
+        memcpy(&loBytes, lo[axis], sizeof(loBytes));
+        memcpy(&hiBytes, hi[axis], sizeof(hiBytes));
+        __m128 qLo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(loBytes), zero), zero));
+        __m128 qHi = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(hiBytes), zero), zero));
+
+        __m128 o = _mm_set1_ps(origin[axis]);
+        __m128 s = _mm_set1_ps(scale(axis));
+        low = _mm_add_ps(o, _mm_mul_ps(qLo, s));
+        high = _mm_add_ps(o, _mm_mul_ps(qHi, s));
+    }
+#endif
+};
+
+inline int WideNode::intersect(const WideRay& ray, float tMax, float* tNear) const
+{
+#if defined(__SSE2__)
+    __m128 t0 = _mm_setzero_ps();
+    __m128 t1 = _mm_set1_ps(tMax);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        __m128 low, high;
+        coordinates(axis, low, high);
+        __m128 tA = _mm_mul_ps(_mm_sub_ps(low, ray.o4[axis]), ray.inv4[axis]);
+        __m128 tB = _mm_mul_ps(_mm_sub_ps(high, ray.o4[axis]), ray.inv4[axis]);
+        t0 = _mm_max_ps(t0, _mm_min_ps(tA, tB));
+        t1 = _mm_min_ps(t1, _mm_max_ps(tA, tB));
+    }
+    _mm_storeu_ps(tNear, t0);
+    int hits = _mm_movemask_ps(_mm_cmple_ps(t0, _mm_mul_ps(t1, _mm_set1_ps(WIDE_NODE_SLACK))));
+    return hits & ((1 << numChildren) - 1);
+#else
+    int hits = 0;
+    for (int c = 0; c < numChildren; c++)
+    {
+        float t0 = 0.0f, t1 = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float s = scale(axis);
+            float tA = (origin[axis] + lo[axis][c] * s - ray.o[axis]) * ray.inv[axis];
+            float tB = (origin[axis] + hi[axis][c] * s - ray.o[axis]) * ray.inv[axis];
+            if (tA > tB) { float tmp = tA; tA = tB; tB = tmp; }
+            t0 = tA > t0 ? tA : t0;
+            t1 = tB < t1 ? tB : t1;
+        }
+        tNear[c] = t0;
+        if (t0 <= t1 * WIDE_NODE_SLACK)
+            hits |= 1 << c;
+    }
+    return hits;
+#endif
+}
+
+// For every ray, the entry into a slab is at least (near - oEntry) times the
+// magnitude of its inverse, taking the smallest magnitude if that distance is
+// positive and the largest otherwise, and the exit at most (far - oExit)
+// times it, the other way round. Distances are measured along the direction
+// of the rays (hence the sign).
+inline int WideNode::intersect(const WidePacket& packet, float tMax) const
+{
+#if defined(__SSE2__)
+    __m128 t0 = _mm_setzero_ps();
+    __m128 t1 = _mm_set1_ps(tMax);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        __m128 low, high;
+        coordinates(axis, low, high);
+        __m128 sign = _mm_set1_ps(packet.sign[axis]);
+        __m128 nearSide = packet.sign[axis] > 0 ? low : high;
+        __m128 farSide = packet.sign[axis] > 0 ? high : low;
+        __m128 dEntry = _mm_mul_ps(_mm_sub_ps(nearSide, _mm_set1_ps(packet.oEntry[axis])), sign);
+        __m128 dExit = _mm_mul_ps(_mm_sub_ps(farSide, _mm_set1_ps(packet.oExit[axis])), sign);
+        __m128 invMin = _mm_set1_ps(packet.invMin[axis]);
+        __m128 invMax = _mm_set1_ps(packet.invMax[axis]);
+        t0 = _mm_max_ps(t0, _mm_min_ps(_mm_mul_ps(dEntry, invMin), _mm_mul_ps(dEntry, invMax)));
+        t1 = _mm_min_ps(t1, _mm_max_ps(_mm_mul_ps(dExit, invMin), _mm_mul_ps(dExit, invMax)));
+    }
+    int hits = _mm_movemask_ps(_mm_cmple_ps(t0, _mm_mul_ps(t1, _mm_set1_ps(WIDE_NODE_SLACK))));
+    return hits & ((1 << numChildren) - 1);
+#else
+    int hits = 0;
+    for (int c = 0; c < numChildren; c++)
+    {
+        float t0 = 0.0f, t1 = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float s = scale(axis);
+            float low = origin[axis] + lo[axis][c] * s, high = origin[axis] + hi[axis][c] * s;
+            float dEntry = ((packet.sign[axis] > 0 ? low : high) - packet.oEntry[axis]) * packet.sign[axis];
+            float dExit = ((packet.sign[axis] > 0 ? high : low) - packet.oExit[axis]) * packet.sign[axis];
+            float tA = dEntry * (dEntry > 0 ? packet.invMin[axis] : packet.invMax[axis]);
+            float tB = dExit * (dExit > 0 ? packet.invMax[axis] : packet.invMin[axis]);
+            t0 = tA > t0 ? tA : t0;
+            t1 = tB < t1 ? tB : t1;
+        }
+        if (t0 <= t1 * WIDE_NODE_SLACK)
+            hits |= 1 << c;
+    }
+    return hits;
+#endif
+}
+
+#endif /* end of include guard: WIDENODE_H_FABIOUX_LEOBAL */